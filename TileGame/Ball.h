@@ -10,7 +10,7 @@
 
 #include <vector>
 
-#include "OgreMotionState.h"
+#include "Simulator.h"
 
 
 class BallManager;
@@ -25,13 +25,49 @@ class Ball {
       rB->setAngularFactor(0.4f);
       rB->setRestitution(0.93);
       rB->setDamping(0.62, 0.08);
+
+      tag.role = ROLE_BALL;
+      tag.owner = this;
+      rB->setUserPointer(&tag);
   }
 
     virtual ~Ball() {
-      delete node;
+      detachNode();
       delete rigidBody;
     }
 
+    // Hands a pooled ball its new node.  The body is reset by the simulator.
+    void reset(Ogre::SceneNode *n) {
+      node = n;
+      tag.role = ROLE_BALL;
+    }
+
+    // Drops the node when the ball goes back into the pool.
+    // Destroys the node and whatever is attached to it through the scene
+    // manager that created them.
+    void detachNode() {
+      destroyNode(node);
+      node = NULL;
+    }
+
+    // Drops the node without destroying it, for callers that have to
+    // leave that to the render thread.
+    Ogre::SceneNode* releaseNode() {
+      Ogre::SceneNode *n = node;
+      node = NULL;
+      return n;
+    }
+
+    static void destroyNode(Ogre::SceneNode *n) {
+      if (n) {
+        Ogre::SceneManager *mgr = n->getCreator();
+
+        while (n->numAttachedObjects() > 0)
+          mgr->destroyMovableObject(n->detachObject((unsigned short) 0));
+        mgr->destroySceneNode(n);
+      }
+    }
+
     void enableGravity() {
       unlockPosition();
 
@@ -39,16 +75,23 @@ class Ball {
       rigidBody->activate(true);
     }
 
+    // A locked ball is static and never wakes by itself, so it goes to
+    // sleep at once instead of keeping its velocity and staying active.
     void lockPosition() {
       rigidBody->setMassProps(0, btVector3(0, 0, 0));
+      rigidBody->setLinearVelocity(btVector3(0, 0, 0));
+      rigidBody->setAngularVelocity(btVector3(0, 0, 0));
+      rigidBody->forceActivationState(ISLAND_SLEEPING);
     }
 
     void unlockPosition() {
       rigidBody->setMassProps(mass, btVector3(0, 0, 0));
+      rigidBody->activate(true);
     }
 
     void setPosition(int x, int y, int z) {
-      node->setPosition(x, y, z);
+      if (node)
+        node->setPosition(x, y, z);
       rigidBody->getMotionState()->setWorldTransform(btTransform(btQuaternion(0, 0, 0, 1),
           btVector3(x, y, z)));
     }
@@ -66,6 +109,10 @@ class Ball {
       return ptr == rigidBody;
     }
 
+    void setRole(int role) {
+      tag.role = role;
+    }
+
     btRigidBody* getRigidBody() {
       return rigidBody;
     }
@@ -78,6 +125,7 @@ class Ball {
     Ogre::SceneNode* node;
     btScalar mass;
     btRigidBody* rigidBody;
+    BodyTag tag;
   };
 
 #endif /* BALL_H_ */
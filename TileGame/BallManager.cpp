@@ -11,12 +11,21 @@ BallManager::BallManager(TileSimulator *sim):
 sim(sim),
 globalBall(0),
 ballCollisions(0),
-globalBallActive(false)
+globalBallActive(false),
+deferNodes(false)
 {
 }
 
 BallManager::~BallManager() {
   clearBalls();
+  destroyRetiredNodes();
+
+  std::vector<Ball *>::iterator it;
+  for (it = ballPool.begin(); it != ballPool.end(); it++) {
+    sim->removeRigidBody((*it)->getRigidBody());
+    delete (*it);
+  }
+  ballPool.clear();
 }
 
 bool BallManager::initBallManager() {
@@ -41,10 +50,27 @@ void BallManager::setPlayerBall(Ball *ball, int idx) {
 }
 
 Ball* BallManager::addBall(Ogre::SceneNode* n, int x, int y, int z, int r) {
-  n->setPosition(x, y, z);
+  if (n)
+    n->setPosition(x, y, z);
+
+  return placeBall(n, btVector3(x, y, z), r);
+}
+
+/* Gives 'n' a ball body at 'pos' without touching the node itself. */
+Ball* BallManager::placeBall(Ogre::SceneNode* n, const btVector3& pos, int r) {
+  Ball *ball;
 
-  btRigidBody *body = sim->addBallShape(n, r);
-  Ball *ball = new Ball(body, n, x, y, z);
+  // Reuse a parked ball and its body before allocating new ones.
+  if (!ballPool.empty()) {
+    ball = ballPool.back();
+    ballPool.pop_back();
+    sim->reuseBallShape(ball->getRigidBody(), n, pos, r);
+    ball->reset(n);
+  } else {
+    btRigidBody *body = sim->addBallShape(n, pos, r);
+    ball = new Ball(body, n, pos.x(), pos.y(), pos.z());
+  }
+  sim->applyCollisionFilter(ball->getRigidBody());
   ballList.push_back(ball);
 
   return ball;
@@ -52,11 +78,34 @@ Ball* BallManager::addBall(Ogre::SceneNode* n, int x, int y, int z, int r) {
 
 Ball* BallManager::addMainBall(Ogre::SceneNode* n, int x, int y, int z, int r) {
   Ball *mainBall = addBall(n, x, y, z, r);
+  mainBall->setRole(ROLE_MAIN_BALL);
+  sim->applyCollisionFilter(mainBall->getRigidBody());
   mainBalls.push_back(mainBall);
 
   return mainBall;
 }
 
+/* Replaces a player's shot, or the global one for 'player' -1, with a new
+ * ball launched from 'pos'.  The caller has already placed 'n' there, so a
+ * physics thread can fire shots without writing to the scene graph. */
+Ball* BallManager::fireBall(int player, Ogre::SceneNode* n, const btVector3& pos, const btVector3& dir, double force) {
+  if (player < 0 && globalBallActive)
+    removeGlobalBall();
+  else if (player >= 0 && playerBallsActive[player])
+    removePlayerBall(player);
+
+  Ball *ball = placeBall(n, pos, 100);
+
+  if (player < 0)
+    setGlobalBall(ball);
+  else
+    setPlayerBall(ball, player);
+
+  ball->applyForce(force, Ogre::Vector3(dir.x(), dir.y(), dir.z()));
+
+  return ball;
+}
+
 void BallManager::enableGravity() {
   std::vector<Ball *>::iterator it;
 
@@ -66,20 +115,29 @@ void BallManager::enableGravity() {
 }
 
 void BallManager::removeBall(Ball* rmBall) {
-  bool found = false;
-
   std::vector<Ball *>::iterator it;
-  for (it = ballList.begin(); it != ballList.end() && !found; it++) {
+  for (it = ballList.begin(); it != ballList.end(); it++) {
     if ((*it) == rmBall) {
       ballList.erase(it);
-      found = true;
+      break;
     }
   }
 
-  btRigidBody* ballBody = rmBall->getRigidBody();
-  sim->getDynamicsWorld().removeRigidBody(ballBody);
-  delete ballBody->getMotionState();
-  delete rmBall;
+  releaseBall(rmBall);
+}
+
+/* Parks the ball's body outside the world and keeps the Ball for reuse. */
+void BallManager::releaseBall(Ball* ball) {
+  sim->parkRigidBody(ball->getRigidBody());
+
+  if (deferNodes) {
+    Ogre::SceneNode *n = ball->releaseNode();
+    if (n)
+      retiredNodes.push_back(n);
+  } else
+    ball->detachNode();
+
+  ballPool.push_back(ball);
 }
 
 void BallManager::removeGlobalBall() {
@@ -105,48 +163,67 @@ bool BallManager::isPlayerBall(int idx) {
 void BallManager::clearBalls() {
   std::vector<Ball *>::iterator it;
 
-  for (it = ballList.begin(); it != ballList.end(); it++) {
-    btRigidBody* ballBody = (*it)->getRigidBody();
-    sim->getDynamicsWorld().removeRigidBody(ballBody);
-    delete ballBody->getMotionState();
-    delete (*it);
-  }
+  for (it = ballList.begin(); it != ballList.end(); it++)
+    releaseBall(*it);
 
   globalBall = NULL;
   globalBallActive = false;
+  playerBalls.assign(playerBalls.size(), NULL);
+  playerBallsActive.assign(playerBallsActive.size(), false);
   ballList.clear();
   mainBalls.clear();
 }
 
+int BallManager::getNumPooledBalls() {
+  return ballPool.size();
+}
+
+/* While deferred, released balls keep their nodes in a list until
+ * destroyRetiredNodes(), for when balls are released off the render thread.
+ * Turning it off destroys whatever is waiting. */
+void BallManager::setDeferNodes(bool defer) {
+  deferNodes = defer;
+
+  if (!defer)
+    destroyRetiredNodes();
+}
+
+int BallManager::getNumRetiredNodes() {
+  return retiredNodes.size();
+}
+
+void BallManager::destroyRetiredNodes() {
+  std::vector<Ogre::SceneNode *>::iterator it;
+
+  for (it = retiredNodes.begin(); it != retiredNodes.end(); it++)
+    Ball::destroyNode(*it);
+  retiredNodes.clear();
+}
+
 TileSimulator* BallManager::getSimulator() {
   return sim;
 }
 
-bool BallManager::checkCollisions(btRigidBody *aTile, void *body0, void *body1) {
+/* Classifies a contact event's pair through the bodies' tags rather than
+ * searching the ball lists.  'activeTile' says the simulator mapped the
+ * contact to the active tile; the main ball involved is locked in place.
+ * Returns true on such a hit. */
+bool BallManager::checkCollisions(bool activeTile, const void *body0, const void *body1) {
   bool hit = false;
-
-  std::vector<Ball *>::iterator it;
-  for (it = mainBalls.begin(); it != mainBalls.end() && !hit; it++) {
-    Ball* mball = (*it);
-
-    if ((aTile == body0 && mball->checkRigidBody((btRigidBody*)body1)) ||
-        (aTile == body1 && mball->checkRigidBody((btRigidBody*)body0))) {
-      mball->lockPosition();
-      hit = true;
-    }
-    if(mball->checkRigidBody((btRigidBody*)body0))
-    {
-      std::vector<Ball *>::iterator it2;
-      for(it2 = mainBalls.begin(); it2 != mainBalls.end(); it2++)
-      {
-        if((*it2) != mball && (*it2)->checkRigidBody((btRigidBody*)body1))
-        {
-          ballCollisions++;
-        }
-      }
-    }
+  int role0 = getBodyRole(body0);
+  int role1 = getBodyRole(body1);
+
+  if (activeTile && role0 == ROLE_MAIN_BALL) {
+    static_cast<Ball *>(getBodyTag(body0)->owner)->lockPosition();
+    hit = true;
+  } else if (activeTile && role1 == ROLE_MAIN_BALL) {
+    static_cast<Ball *>(getBodyTag(body1)->owner)->lockPosition();
+    hit = true;
   }
 
+  if (role0 == ROLE_MAIN_BALL && role1 == ROLE_MAIN_BALL)
+    ballCollisions++;
+
   return hit;
 }
 
@@ -29,6 +29,7 @@ public:
   void setPlayerBall(Ball *ball, int idx);
   Ball* addBall(Ogre::SceneNode* n, int x, int y, int z, int r);
   Ball* addMainBall(Ogre::SceneNode* n, int x, int y, int z, int r);
+  Ball* fireBall(int player, Ogre::SceneNode* n, const btVector3& pos, const btVector3& dir, double force);
   void enableGravity();
   void removeBall(Ball* rmBall);
   void removeGlobalBall();
@@ -37,17 +38,27 @@ public:
   bool isPlayerBall(int idx);
   void clearBalls();
   int getNumberBallCollisions();
+  int getNumPooledBalls();
+  void setDeferNodes(bool defer);
+  int getNumRetiredNodes();
+  void destroyRetiredNodes();
 
   TileSimulator* getSimulator();
 
-  bool checkCollisions(btRigidBody *aTile, void *body0, void *body1);
+  bool checkCollisions(bool activeTile, const void *body0, const void *body1);
 
 private:
+  Ball* placeBall(Ogre::SceneNode* n, const btVector3& pos, int r);
+  void releaseBall(Ball* ball);
+
   std::vector<Ball *> ballList;
+  std::vector<Ball *> ballPool;
   std::vector<Ball *> mainBalls;
   std::vector<bool> playerBallsActive;
+  std::vector<Ogre::SceneNode *> retiredNodes;    // released while deferNodes, not yet destroyed.
   TileSimulator *sim;
   bool globalBallActive;
+  bool deferNodes;
   int ballCollisions;
 };
 
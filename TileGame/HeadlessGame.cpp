@@ -0,0 +1,243 @@
+#include "HeadlessGame.h"
+
+
+HeadlessGame::HeadlessGame():
+sim(0),
+ballMgr(0),
+levelMgr(0),
+seed(1),
+frameTime(1/60.0),
+levelStart(0),
+nextShot(0),
+endTick(0),
+stepTicks(1),
+tilesLeft(0),
+tileCounter(0),
+partyBalls(0),
+gameDone(false)
+{
+  resetStats();
+}
+
+HeadlessGame::~HeadlessGame() {
+  delete levelMgr;
+  delete ballMgr;
+  delete sim;
+}
+
+bool HeadlessGame::initHeadlessGame(unsigned int s, const PhysicsConfig& config) {
+  seed = s;
+
+  sim = new TileSimulator();
+  sim->setPhysicsConfig(config);
+  sim->setArena(arena);
+  sim->initSimulator();
+  sim->createBounds(arena.getPlaneDist());
+  stepTicks = sim->getMaxTicks();
+
+  ballMgr = new BallManager(sim);
+  levelMgr = new LevelManager(NULL, sim, ballMgr);
+
+  return ballMgr->initBallManager();
+}
+
+/* Mirrors TileGame::levelSetup() minus the meshes and sounds. */
+void HeadlessGame::levelSetup(int num) {
+  srand(seed + num);
+
+  std::vector<int> tileNums = arena.pickTileNumbers(num);
+  num = tileNums.size();
+
+  for (int i = 0; i < num; i++) {
+    sim->addTile(tileNums[i]);
+  }
+  tileCounter += num;
+  tilesLeft = num;
+
+  int numBalls = arena.getNumBalls(num);
+  int ballSize = arena.getBallSize(numBalls);
+  for (int i = 0; i < numBalls; i++) {
+    btVector3 pos = arena.getBallPosition(numBalls, i);
+    ballMgr->addMainBall(NULL, pos.x(), pos.y(), pos.z(), ballSize/2);
+  }
+
+  int range = arena.getPlaneDist() - 2 * PARTY_RADIUS;
+  for (int i = 0; i < partyBalls; i++) {
+    int x = rand() % (2 * range) - range;
+    int y = rand() % (2 * range) - range;
+    int z = rand() % (2 * range) - range;
+    ballMgr->addBall(NULL, x, y, z, PARTY_RADIUS)->enableGravity();
+  }
+
+  gameDone = false;
+  levelStart = nextShot = sim->getTickCount();
+  stats.levels++;
+
+  sim->saveSnapshot(levelSnapshot);
+}
+
+/* Puts the current level back to how levelSetup() left it without tearing
+ * anything down: the shot in flight is removed and every main ball, the
+ * tile list and the tick count are restored from the level's snapshot. */
+bool HeadlessGame::restartLevel() {
+  if (ballMgr->isGlobalBall())
+    ballMgr->removeGlobalBall();
+
+  stepTimer.reset();
+  bool restored = sim->restoreSnapshot(levelSnapshot);
+  stats.restoreUs += stepTimer.getMicroseconds();
+
+  if (!restored)
+    return false;
+
+  tilesLeft = sim->getNumTiles();
+  gameDone = false;
+  nextShot = levelStart;
+  stats.restores++;
+
+  return true;
+}
+
+void HeadlessGame::levelTearDown() {
+  levelMgr->tearDown();
+}
+
+/* Fires from the corner the camera starts in toward the active tile, the
+ * same way TileGame::mouseReleased() does for the player.  The shot is
+ * stamped with the current tick and fires before the next one runs. */
+void HeadlessGame::shootBall(double force) {
+  int target = sim->getActiveTile();
+  if (target < 0)
+    return;
+
+  int corner = arena.getPlaneDist() * 5 / 6;
+  btVector3 origin(corner, 0, corner);
+
+  ShotInput shot;
+  shot.tick = sim->getTickCount();
+  shot.player = -1;
+  shot.node = NULL;
+  shot.position = origin;
+  shot.direction = (arena.getTileSlot(target).position - origin).normalized();
+  shot.force = force;
+
+  sim->queueShot(shot);
+  stats.shots++;
+}
+
+/* One rendered frame's worth of game logic.  Shots are scheduled in physics
+ * ticks so a run plays out the same at any frame rate.  Returns true if any
+ * tile was hit. */
+bool HeadlessGame::frame() {
+  unsigned long ticks = sim->getTickCount();
+
+  if (!gameDone && ticks >= nextShot) {
+    shootBall(SHOT_FORCE);
+    nextShot = ticks + SHOT_TICKS;
+  }
+
+  // A deterministic run stops each step on the next tick the script acts
+  // on, and the simulator carries the rest of the frame over, so shots and
+  // the end of the level land on the same ticks whatever the frame rate.
+  if (sim->getPhysicsConfig().deterministic) {
+    unsigned long stop = endTick;
+    if (!gameDone && nextShot < stop)
+      stop = nextShot;
+
+    int budget = stepTicks;
+    if (stop > ticks && stop - ticks < (unsigned long) budget)
+      budget = stop - ticks;
+    sim->setMaxTicks(budget);
+  }
+
+  stepTimer.reset();
+  bool hit = sim->simulateStep(frameTime);
+  unsigned long us = stepTimer.getMicroseconds();
+
+  stats.totalUs += us;
+  if (us > stats.maxUs)
+    stats.maxUs = us;
+  stats.frames++;
+  stats.ticks += sim->getTickCount() - ticks;
+
+  ballMgr->getNumberBallCollisions();
+
+  // The simulator drops the balls on the tick the last tile is hit.
+  for (int i = sim->getNumHits(); i > 0 && !gameDone; i--) {
+    stats.hits++;
+
+    if (--tilesLeft <= 0)
+      gameDone = true;
+  }
+
+  return hit;
+}
+
+/* Sets up, plays and tears down one level.  Returns true if the level was
+ * cleared. */
+bool HeadlessGame::runLevel(int num, int maxTicks) {
+  levelSetup(num);
+  bool cleared = playLevel(maxTicks);
+  levelTearDown();
+
+  return cleared;
+}
+
+/* Plays the level already set up until it is cleared (plus the win delay)
+ * or until maxTicks ticks have passed since it started. */
+bool HeadlessGame::playLevel(int maxTicks) {
+  endTick = levelStart + maxTicks;
+
+  while (sim->getTickCount() < endTick) {
+    frame();
+
+    if (gameDone && sim->getClearedTick() + WIN_TICKS < endTick)
+      endTick = sim->getClearedTick() + WIN_TICKS;
+  }
+
+  return gameDone;
+}
+
+/* Party mode: every level also drops 'n' loose balls at random points in
+ * the arena, to load the physics with far more bodies than a level has. */
+void HeadlessGame::setPartyBalls(int n) {
+  partyBalls = n > 0 ? n : 0;
+}
+
+/* The arena levels are generated in.  Takes effect at initHeadlessGame(). */
+void HeadlessGame::setArena(const ArenaLayout& layout) {
+  arena = layout;
+}
+
+void HeadlessGame::resetStats() {
+  stats.frames = stats.hits = stats.shots = stats.levels = 0;
+  stats.ticks = stats.totalUs = stats.maxUs = 0;
+  stats.restores = 0;
+  stats.restoreUs = 0;
+}
+
+/* Frame time handed to simulateStep() by frame(). */
+void HeadlessGame::setFrameRate(int fps) {
+  if (fps > 0)
+    frameTime = 1.0 / fps;
+}
+
+TileSimulator* HeadlessGame::getSimulator() {
+  return sim;
+}
+
+BallManager* HeadlessGame::getBallManager() {
+  return ballMgr;
+}
+
+LevelManager* HeadlessGame::getLevelManager() {
+  return levelMgr;
+}
+
+const HeadlessStats& HeadlessGame::getStats() {
+  return stats;
+}
+
+bool HeadlessGame::isLevelDone() {
+  return gameDone;
+}
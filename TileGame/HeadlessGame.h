@@ -0,0 +1,80 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    HeadlessGame.h
+-----------------------------------------------------------------------------
+
+Drives TileSimulator and BallManager through the same level and tile logic
+as TileGame, but without a render window, OIS or SDL_mixer.  Balls are
+created with NULL scene nodes and shots are fired by a simple script.
+-----------------------------------------------------------------------------
+ */
+#ifndef __HeadlessGame_h_
+#define __HeadlessGame_h_
+
+#include "TileSimulator.h"
+#include "BallManager.h"
+#include "LevelManager.h"
+#include "TileLayout.h"
+
+#include <OgreTimer.h>
+
+
+const static int SHOT_TICKS = 90;               // physics ticks between scripted shots.
+const static int SHOT_FORCE = 8500;             // a fully charged shot.
+const static int WIN_TICKS = 320;               // ticks simulated after a win.
+const static int PARTY_RADIUS = 50;             // loose balls added by setPartyBalls().
+
+struct HeadlessStats {
+  int frames;
+  unsigned long ticks;
+  int hits;
+  int shots;
+  int levels;
+  unsigned long totalUs;                        // time spent in simulateStep.
+  unsigned long maxUs;
+  int restores;
+  unsigned long restoreUs;                      // time spent in restoreSnapshot.
+};
+
+class HeadlessGame {
+public:
+  HeadlessGame();
+  virtual ~HeadlessGame();
+
+  bool initHeadlessGame(unsigned int seed, const PhysicsConfig& config = PhysicsConfig());
+  void levelSetup(int num);
+  void levelTearDown();
+  void shootBall(double force);
+  bool restartLevel();
+  bool frame();
+  bool playLevel(int maxTicks);
+  bool runLevel(int num, int maxTicks);
+  void setFrameRate(int fps);
+  void setPartyBalls(int n);
+  void setArena(const ArenaLayout& layout);
+  void resetStats();
+
+  TileSimulator* getSimulator();
+  BallManager* getBallManager();
+  LevelManager* getLevelManager();
+  const HeadlessStats& getStats();
+  bool isLevelDone();
+
+protected:
+  TileSimulator *sim;
+  BallManager *ballMgr;
+  LevelManager *levelMgr;
+  Ogre::Timer stepTimer;
+  HeadlessStats stats;
+  WorldSnapshot levelSnapshot;                  // the world right after levelSetup().
+  ArenaLayout arena;
+  unsigned int seed;
+  double frameTime;
+  unsigned long levelStart, nextShot, endTick;
+  int stepTicks;                                // the simulator's own tick budget per frame.
+  int tilesLeft, tileCounter;
+  int partyBalls;
+  bool gameDone;
+};
+
+#endif // #ifndef __HeadlessGame_h_
@@ -0,0 +1,71 @@
+#include "LevelManager.h"
+
+
+LevelManager::LevelManager(Ogre::SceneManager *mgr, TileSimulator *sim, BallManager *ballMgr):
+sceneMgr(mgr),
+sim(sim),
+ballMgr(ballMgr)
+{
+}
+
+LevelManager::~LevelManager() {
+  tearDown();
+}
+
+Ogre::SceneNode* LevelManager::createNode(Ogre::SceneNode *parent) {
+  Ogre::SceneNode *node = parent->createChildSceneNode();
+  nodes.push_back(node);
+
+  return node;
+}
+
+Ogre::Entity* LevelManager::createEntity(const std::string& name, const std::string& mesh) {
+  Ogre::Entity *entity = sceneMgr->createEntity(name, mesh);
+  entities.push_back(entity);
+
+  return entity;
+}
+
+/* A square plane mesh of the tile's subdivision and texture tiling. */
+void LevelManager::createPlaneMesh(const std::string& name, const Ogre::Plane& plane, Ogre::Real size) {
+  Ogre::MeshManager::getSingleton().createPlane(name,
+      Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, plane,
+      size, size, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
+  meshes.push_back(name);
+}
+
+/* Entities go before the meshes they use; balls go back to the pool. */
+void LevelManager::tearDown() {
+  ballMgr->clearBalls();
+  sim->clearTiles();
+
+  if (sceneMgr) {
+    std::vector<Ogre::Entity *>::iterator eit;
+    for (eit = entities.begin(); eit != entities.end(); eit++)
+      sceneMgr->destroyEntity(*eit);
+
+    std::vector<Ogre::SceneNode *>::iterator nit;
+    for (nit = nodes.begin(); nit != nodes.end(); nit++)
+      sceneMgr->destroySceneNode(*nit);
+
+    std::vector<std::string>::iterator mit;
+    for (mit = meshes.begin(); mit != meshes.end(); mit++)
+      Ogre::MeshManager::getSingleton().remove(*mit);
+  }
+
+  entities.clear();
+  nodes.clear();
+  meshes.clear();
+}
+
+int LevelManager::getNumMeshes() {
+  return meshes.size();
+}
+
+int LevelManager::getNumEntities() {
+  return entities.size();
+}
+
+int LevelManager::getNumNodes() {
+  return nodes.size();
+}
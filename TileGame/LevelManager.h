@@ -0,0 +1,52 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    LevelManager.h
+-----------------------------------------------------------------------------
+
+Owns everything a level creates: tile meshes, entities and scene nodes on
+the Ogre side, and the balls and live tiles in the simulation.  Tiles have
+no bodies; they are arena slots the simulator hits through wall contacts.
+tearDown() returns the balls to the ball pool, clears the live tiles and
+any queued shots, and destroys the Ogre objects, so nothing accumulates
+from one level to the next.  The scene manager may be NULL, as it is in
+the headless build.
+-----------------------------------------------------------------------------
+ */
+#ifndef __LevelManager_h_
+#define __LevelManager_h_
+
+#include <OgreSceneManager.h>
+#include <OgreEntity.h>
+#include <OgreMeshManager.h>
+#include <string>
+#include <vector>
+
+#include "TileSimulator.h"
+#include "BallManager.h"
+
+
+class LevelManager {
+public:
+  LevelManager(Ogre::SceneManager *mgr, TileSimulator *sim, BallManager *ballMgr);
+  virtual ~LevelManager();
+
+  Ogre::SceneNode* createNode(Ogre::SceneNode *parent);
+  Ogre::Entity* createEntity(const std::string& name, const std::string& mesh);
+  void createPlaneMesh(const std::string& name, const Ogre::Plane& plane, Ogre::Real size);
+  void tearDown();
+
+  int getNumMeshes();
+  int getNumEntities();
+  int getNumNodes();
+
+private:
+  Ogre::SceneManager *sceneMgr;
+  TileSimulator *sim;
+  BallManager *ballMgr;
+
+  std::vector<std::string> meshes;
+  std::vector<Ogre::Entity *> entities;
+  std::vector<Ogre::SceneNode *> nodes;
+};
+
+#endif // #ifndef __LevelManager_h_
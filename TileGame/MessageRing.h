@@ -0,0 +1,167 @@
+/**
+ * @file MessageRing.h
+ *
+ * @brief A queue of variable-length messages in one fixed block of memory,
+ * used by NetManager to hand received data to the game and to hold data the
+ * game wants sent.
+ *
+ * One thread may push while another reads; neither takes a lock.  Each
+ * message is stored whole, word aligned and followed by a NUL, so readers can
+ * cast it to Uint32 tags or read it as text in place.  A message that does not
+ * fit is refused and counted rather than overwriting unread ones.
+ */
+
+#ifndef MESSAGERING_H_
+#define MESSAGERING_H_
+
+
+#include <cstring>
+#include "SDLnet/SDL_net.h"
+
+
+class MessageRing {
+public:
+  enum {
+    MAX_LENGTH          = 4088        //!< Longest message that can ever be queued.
+  };
+
+  MessageRing(): head(0), tail(0), dropped(0) {}
+
+  /**
+   * @brief Queues a copy of a message.
+   * @param data The message.
+   * @param len Its length in bytes.
+   * @return False, queuing nothing, if the ring is too full.
+   */
+  bool push(const void *data, int len) {
+    return push(data, len, NULL, 0);
+  }
+
+  /**
+   * @brief Queues a tag followed by a body as one message.
+   * @param tag One of the UINT_XXX packet tags.
+   * @param body The message body.
+   * @param len Length of the body in bytes.
+   * @return False, queuing nothing, if the ring is too full.
+   */
+  bool push(Uint32 tag, const void *body, int len) {
+    return push(&tag, sizeof(tag), body, len);
+  }
+
+  /**
+   * @brief Peeks at the oldest message without consuming it.
+   * @param len Set to the message's length.
+   * @return The message, or NULL if the ring is empty.
+   */
+  const char* front(int *len) {
+    for (;;) {
+      if (head == tail)
+        return NULL;
+
+      __sync_synchronize();
+      Uint32 pos = head % RING_BYTES;
+      Uint32 size = words[pos / 4];
+
+      if (size == WRAP) {
+        __sync_synchronize();
+        head += RING_BYTES - pos;
+        continue;
+      }
+
+      *len = size;
+      return (const char *) &words[pos / 4 + 1];
+    }
+  }
+
+  /**
+   * @brief Consumes the message returned by front().
+   */
+  void pop() {
+    int len;
+
+    if (!front(&len))
+      return;
+
+    __sync_synchronize();
+    head += footprint(len);
+  }
+
+  /**
+   * @brief Consumes every queued message.  Reader side only.
+   */
+  void clear() {
+    int len;
+
+    while (front(&len))
+      pop();
+  }
+
+  bool empty() {
+    int len;
+    return front(&len) == NULL;
+  }
+
+  /**
+   * @brief Messages refused since the last call.
+   */
+  int takeDropped() {
+    return __sync_fetch_and_and(&dropped, 0);
+  }
+
+private:
+  enum {
+    RING_BYTES          = 16384,      //!< Power of two, so positions survive counter wrap.
+    MAX_MESSAGE         = RING_BYTES / 4  //!< Largest footprint; that of MAX_LENGTH.
+  };
+
+  static const Uint32 WRAP = 0xFFFFFFFF;  //!< Length word marking the unused end of the block.
+
+  /** Bytes a message of 'len' takes: length word, body, NUL, padding. */
+  static Uint32 footprint(int len) {
+    return 4 + ((len + 4) & ~3);
+  }
+
+  bool push(const void *part1, int len1, const void *part2, int len2) {
+    int len = len1 + len2;
+
+    if (len < 0 || (int) footprint(len) > MAX_MESSAGE) {
+      __sync_fetch_and_add(&dropped, 1);
+      return false;
+    }
+
+    Uint32 need = footprint(len);
+    Uint32 t = tail;
+    Uint32 pos = t % RING_BYTES;
+    Uint32 skip = (pos + need > RING_BYTES) ? RING_BYTES - pos : 0;
+
+    if (RING_BYTES - (t - head) < skip + need) {
+      __sync_fetch_and_add(&dropped, 1);
+      return false;
+    }
+
+    if (skip) {
+      words[pos / 4] = WRAP;
+      t += skip;
+      pos = 0;
+    }
+
+    char *body = (char *) &words[pos / 4 + 1];
+    words[pos / 4] = len;
+    memcpy(body, part1, len1);
+    if (len2)
+      memcpy(body + len1, part2, len2);
+    body[len] = '\0';
+
+    __sync_synchronize();
+    tail = t + need;
+
+    return true;
+  }
+
+  Uint32 words[RING_BYTES / 4];
+  volatile Uint32 head;               //!< Bytes ever consumed; written by the reader.
+  volatile Uint32 tail;               //!< Bytes ever queued; written by the writer.
+  volatile int dropped;
+};
+
+#endif /* MESSAGERING_H_ */
@@ -78,7 +78,6 @@ NetManager::~NetManager() {
  */
 bool NetManager::initNetManager() {
   bool ret = true;
-  int i;
 
   socketNursery = SDLNet_AllocSocketSet(SOCKET_ALL_MAX);
 
@@ -94,9 +93,9 @@ bool NetManager::initNetManager() {
     netServer.udpDataIdx = -1;
     netServer.clientIdx = -1;
     netServer.protocols = 0;
-    for (i = 0; i < MESSAGE_COUNT; i++) {
-      udpServerData[i].updated = false;
-    }
+    tcpServerData.output.clear();
+    tcpServerData.stream.clear();
+    udpServerData.output.clear();
     netStatus |= NET_INITIALIZED;
   }
 
@@ -207,7 +206,7 @@ bool NetManager::startClient() {
  * If activity is detected, it will be automatically handled according to its
  * protocol and the server or client configuration. New clients and data will
  * be processed before this function returns. If the return is \b true, the
- * <em> user should immediately scan the external MessageInfo bins </em> for
+ * <em> user should drain the external ClientData rings </em> of
  * newly output data.
  * @param timeout_ms Time in milliseconds to block and poll. Default: 5 seconds.
  * @return True for activity, false for no activity.
@@ -236,14 +235,16 @@ int NetManager::scanForActivity() {
  * @brief Send a single message to all clients.
  *
  * Must be running as a server to call this function. If no arguments are given,
- * it will pull from each client's ClientData \b input field.
+ * it will drain the server's ClientData \b input rings, sending every queued
+ * message to every client.  UDP datagrams carry exactly the message's bytes,
+ * up to MESSAGE_LENGTH.
  * @param protocol TCP, UDP, or ALL as given by PROTOCOL_XXX enum value.
  * @param buf Manually given data buffer. Default: NULL.
  * @param len Length of given buffer. Default: 0.
  */
 void NetManager::messageClients(Protocol protocol, const char *buf, int len) {
-  int i, j, length;
-  char *data;
+  int i, length;
+  const char *data;
 
   if (statusCheck(NET_SERVER)) {
     printError("NetManager: No server running, and thus no clients to message.");
@@ -255,62 +256,64 @@ void NetManager::messageClients(Protocol protocol, const char *buf, int len) {
     return;
   }
 
-  if (buf && (0 <= len) && (len < MESSAGE_LENGTH)) {
-    length = len ? : strlen(buf);
+  if (buf) {
+    length = (len > 0) ? len : strlen(buf);
+
+    tcpBatch.clear();
+    if (protocol & PROTOCOL_TCP)
+      frameTCP(tcpBatch, buf, length);
 
     for (i = 0; i < netClients.size(); i++) {
-      if (protocol & (netClients[i]->protocols & PROTOCOL_TCP)) {
-        sendTCP(tcpSockets[netClients[i]->tcpSocketIdx], buf, length);
+      if (!tcpBatch.empty() && (netClients[i]->protocols & PROTOCOL_TCP)) {
+        sendTCP(tcpSockets[netClients[i]->tcpSocketIdx], tcpBatch.data(),
+            tcpBatch.size());
       }
       if (protocol & netClients[i]->protocols & PROTOCOL_UDP) {
-        UDPpacket *pack = craftUDPpacket(buf, length);
-        if (pack) {
-          sendUDP(udpSockets[netClients[i]->udpSocketIdx],
-              netClients[i]->udpChannel, pack);
-        }
+        sendUDP(udpSockets[netClients[i]->udpSocketIdx],
+            netClients[i]->udpChannel, buf, length);
       }
     }
   } else {
-    length = MESSAGE_LENGTH;
-    UDPpacket *pack;
-
-    for (i = 0; i < netClients.size(); i++) {
-      if (protocol & netClients[i]->protocols & PROTOCOL_TCP) {
-        data = tcpServerData.input;
-        sendTCP(tcpSockets[netClients[i]->tcpSocketIdx], data, length);
-        tcpServerData.updated = false;
+    // Every queued TCP message goes to each client in a single send.
+    tcpBatch.clear();
+    while ((protocol & PROTOCOL_TCP) && (data = tcpServerData.input.front(&length))) {
+      frameTCP(tcpBatch, data, length);
+      tcpServerData.input.pop();
+    }
+    for (i = 0; i < netClients.size() && !tcpBatch.empty(); i++) {
+      if (netClients[i]->protocols & PROTOCOL_TCP) {
+        sendTCP(tcpSockets[netClients[i]->tcpSocketIdx], tcpBatch.data(),
+            tcpBatch.size());
       }
-      if (protocol & netClients[i]->protocols & PROTOCOL_UDP) {
-        for (j = 0; j < MESSAGE_COUNT; j++) {
-          if (udpServerData[j].updated) {
-            data = udpServerData[j].input;
-            pack = craftUDPpacket(data, length);
-            if (pack) {
-              sendUDP(udpSockets[netClients[i]->udpSocketIdx],
-                  netClients[i]->udpChannel, pack);
-            }
-          }
+    }
+    while ((protocol & PROTOCOL_UDP) && (data = udpServerData.input.front(&length))) {
+      for (i = 0; i < netClients.size(); i++) {
+        if (netClients[i]->protocols & PROTOCOL_UDP) {
+          sendUDP(udpSockets[netClients[i]->udpSocketIdx],
+              netClients[i]->udpChannel, data, length);
         }
       }
-    }
-    for (j = 0; j < MESSAGE_COUNT; j++) {
-      udpServerData[j].updated = false;
+      udpServerData.input.pop();
     }
   }
+
+  reportDropped(tcpServerData.input, "TCP send");
+  reportDropped(udpServerData.input, "UDP send");
 }
 
 /**
  * @brief Send a single message to the server.
  *
  * Must be running as a client to call this function. If no arguments are given,
- * it will pull from the server's ClientData \b input field.
+ * it will drain the server's ClientData \b input rings.  UDP datagrams carry
+ * exactly the message's bytes, up to MESSAGE_LENGTH.
  * @param protocol TCP, UDP, or ALL as given by PROTOCOL_XXX enum value.
  * @param buf Manually given data buffer. Default: NULL.
  * @param len Length of given buffer. Default: 0.
  */
 void NetManager::messageServer(Protocol protocol, const char *buf, int len) {
   int length;
-  char *data;
+  const char *data;
 
   if (statusCheck(NET_CLIENT)) {
     printError("NetManager: No client running, and thus no server to message.");
@@ -322,34 +325,37 @@ void NetManager::messageServer(Protocol protocol, const char *buf, int len) {
     return;
   }
 
-  if (buf && (0 <= len) && (len < MESSAGE_LENGTH)) {
-    length = len ? : strlen(buf);
+  if (buf) {
+    length = (len > 0) ? len : strlen(buf);
 
-    if (protocol & PROTOCOL_TCP) {
-      sendTCP(tcpSockets[netServer.tcpSocketIdx], buf, length);
+    tcpBatch.clear();
+    if ((protocol & PROTOCOL_TCP) && frameTCP(tcpBatch, buf, length)) {
+      sendTCP(tcpSockets[netServer.tcpSocketIdx], tcpBatch.data(),
+          tcpBatch.size());
     }
     if (protocol & PROTOCOL_UDP) {
-      UDPpacket *pack = craftUDPpacket(buf, length);
-      if (pack) {
-        sendUDP(udpSockets[netServer.udpSocketIdx], netServer.udpChannel, pack);
-      }
+      sendUDP(udpSockets[netServer.udpSocketIdx], netServer.udpChannel, buf,
+          length);
     }
   } else {
-    length = MESSAGE_LENGTH;
-
-    if (protocol & PROTOCOL_TCP) {
-      data = tcpServerData.input;
-      sendTCP(tcpSockets[netServer.tcpSocketIdx], data, length);
-      tcpServerData.updated = false;
+    tcpBatch.clear();
+    while ((protocol & PROTOCOL_TCP) && (data = tcpServerData.input.front(&length))) {
+      frameTCP(tcpBatch, data, length);
+      tcpServerData.input.pop();
     }
-    if (protocol & PROTOCOL_UDP) {
-      data = udpServerData[0].input;
-      UDPpacket *pack = craftUDPpacket(data, length);
-      if (pack)
-        sendUDP(udpSockets[netServer.udpSocketIdx], netServer.udpChannel, pack);
-      udpServerData[0].updated = false;
+    if (!tcpBatch.empty()) {
+      sendTCP(tcpSockets[netServer.tcpSocketIdx], tcpBatch.data(),
+          tcpBatch.size());
+    }
+    while ((protocol & PROTOCOL_UDP) && (data = udpServerData.input.front(&length))) {
+      sendUDP(udpSockets[netServer.udpSocketIdx], netServer.udpChannel, data,
+          length);
+      udpServerData.input.pop();
     }
   }
+
+  reportDropped(tcpServerData.input, "TCP send");
+  reportDropped(udpServerData.input, "UDP send");
 }
 
 /**
@@ -375,16 +381,13 @@ void NetManager::messageClient(Protocol protocol, int clientDataIdx, char *buf,
   if (protocol & PROTOCOL_TCP) {
     cInfo = lookupClient(tcpClientData[clientDataIdx]->host, false);
     TCPsocket client = tcpSockets[cInfo->tcpSocketIdx];
-    sendTCP(client, buf, len);
-    tcpClientData[clientDataIdx]->updated = false;
+    tcpBatch.clear();
+    if (frameTCP(tcpBatch, buf, len))
+      sendTCP(client, tcpBatch.data(), tcpBatch.size());
   } else if (protocol & PROTOCOL_UDP) {
     cInfo = lookupClient(udpClientData[clientDataIdx]->host, false);
-    UDPpacket *pack = craftUDPpacket(buf, len);
     UDPsocket client = udpSockets[cInfo->udpSocketIdx];
-    if (pack) {
-      sendUDP(client, cInfo->udpChannel, pack);
-      udpClientData[clientDataIdx]->updated = false;
-    }
+    sendUDP(client, cInfo->udpChannel, buf, len);
   }
 }
 
@@ -469,6 +472,8 @@ void NetManager::stopServer(Protocol protocol) {
       unwatchSocket(udpSockets[i]);
       closeUDP(udpSockets[i]);
       udpSockets.pop_back();
+      freeUDPpacketV(&udpPacketPools.back());
+      udpPacketPools.pop_back();
     }
     netServer.protocols ^= PROTOCOL_UDP;
     clearFlags(NET_UDP_OPEN | NET_UDP_BOUND);
@@ -509,6 +514,7 @@ void NetManager::stopClient(Protocol protocol) {
     unwatchSocket(server);
     closeTCP(server);
     tcpSockets.pop_back();
+    tcpServerData.stream.clear();
     netServer.protocols ^= PROTOCOL_TCP;
   }
   if (netServer.protocols & (protocol & PROTOCOL_UDP)) {
@@ -517,6 +523,8 @@ void NetManager::stopClient(Protocol protocol) {
     unbindUDPSocket(server, netServer.udpChannel);
     closeUDP(server);
     udpSockets.pop_back();
+    freeUDPpacketV(&udpPacketPools.back());
+    udpPacketPools.pop_back();
     netServer.protocols ^= PROTOCOL_UDP;
   }
 
@@ -740,16 +748,13 @@ bool NetManager::broadcastUDPInvitation(int maskDepth) {
   std::ostringstream broadcast;
   std::string data;
   IPaddress addr;
-  UDPpacket *packet;
 
   SDLNet_ResolveHost(&addr, getMaskedIPstring(maskDepth).c_str(), PORT_DEFAULT);
 
   broadcast << STR_OPEN << getIPstring();
   data = broadcast.str();
-  packet = craftUDPpacket(data.c_str(), data.length());
-  packet->address.host = addr.host;
-  packet->address.port = addr.port;
-  sendUDP(udpSockets[netServer.udpSocketIdx], -1, packet);
+  sendUDP(udpSockets[netServer.udpSocketIdx], -1, data.c_str(), data.length(),
+      &addr);
   printError("NetManager: UDP Broadcast sent.");
 
   return scanForActivity();
@@ -891,7 +896,8 @@ bool NetManager::openTCPSocket(IPaddress *addr) {
  *
  * A state-bound and error-checked wrapper of the SDLNet_UDP_Open call. Servers
  * and clients both stop here, as they differ only in how incoming connections
- * are handled.
+ * are handled.  Each socket gets its own pool of receive packets, allocated
+ * here once and reused by every read.
  * @param port The port on which to open the socket.
  * @return True on success, false on failure.
  */
@@ -912,6 +918,7 @@ bool NetManager::openUDPSocket(Uint16 port) {
     ret = false;
   } else {
     udpSockets.push_back(udpSock);
+    udpPacketPools.push_back(allocUDPpacketV(MESSAGE_COUNT, MESSAGE_LENGTH));
     watchSocket(udpSock);
 
     if (!(netStatus & NET_UDP_OPEN)) {
@@ -962,7 +969,6 @@ bool NetManager::acceptTCP(TCPsocket server) {
     IPaddress *addr = queryTCPAddress(tcpSock);
     ConnectionInfo *client = lookupClient(addr->host, true);
     buffer->host = addr->host;
-    buffer->updated = false;
     client->protocols |= PROTOCOL_TCP;
     client->address.host = addr->host;
     client->address.port = addr->port;
@@ -1016,7 +1022,6 @@ bool NetManager::bindUDPSocket (UDPsocket sock, int channel, IPaddress *addr) {
     ClientData *buffer = new ClientData;
     ConnectionInfo *client = lookupClient(addr->host, true);
     buffer->host = addr->host;
-    buffer->updated = false;
     client->protocols |= PROTOCOL_UDP;
     client->address.host = addr->host;
     client->address.port = addr->port;
@@ -1076,6 +1081,7 @@ bool NetManager::sendTCP(TCPsocket sock, const void *data, int len) {
  * A state-bound and error-checked wrapper of the SDLNet_UDP_Send call. One
  * channel-bound target \e may receive one copy of the given message. No
  * guarantees are given by UDP, and I have coded no guarantees here, yet.
+ * The packet remains the caller's.
  * @param sock The target's socket.
  * @param channel The target's specific, bound channel.
  * @param pack The SDL-formatted UDP packet to send.
@@ -1095,11 +1101,41 @@ bool NetManager::sendUDP(UDPsocket sock, int channel, UDPpacket *pack) {
     ret = false;
   }
 
-  freeUDPpacket(&pack);
-
   return ret;
 }
 
+/**
+ * @brief Send a caller's buffer to a single target via UDP without copying it.
+ *
+ * The buffer is wrapped in a UDPpacket on the stack and handed straight to
+ * the socket, so relaying one update to many clients allocates nothing.
+ * @param sock The target's socket.
+ * @param channel The target's bound channel, or -1 to send to addr.
+ * @param data The data to send.
+ * @param len The length of the data.
+ * @param addr The destination of an unbound send. Default: NULL.
+ * @return True on success, false on failure.
+ */
+bool NetManager::sendUDP(UDPsocket sock, int channel, const void *data, int len,
+    IPaddress *addr) {
+  UDPpacket pack;
+
+  if (len > MESSAGE_LENGTH) {
+    printError("NetManager: Message length exceeds current maximum.");
+    return false;
+  }
+
+  pack.channel = channel;
+  pack.data = (Uint8 *) data;
+  pack.len = len;
+  pack.maxlen = len;
+  pack.status = 0;
+  pack.address.host = addr ? addr->host : 0;
+  pack.address.port = addr ? addr->port : 0;
+
+  return sendUDP(sock, channel, &pack);
+}
+
 /**
  * @brief Receive a single message from a single target via TCP.
  *
@@ -1109,15 +1145,15 @@ bool NetManager::sendUDP(UDPsocket sock, int channel, UDPpacket *pack) {
  * @param maxlen The maximum length of data to copy to the destination buffer.
  * @return True on success, false on failure.
  */
-bool NetManager::recvTCP(TCPsocket sock, void *data, int maxlen) {
-  bool ret = true;
+int NetManager::recvTCP(TCPsocket sock, void *data, int maxlen) {
+  int ret;
 
   if (statusCheck(NET_TCP_ACCEPT, (NET_CLIENT | NET_TCP_OPEN)))
-    return false;
+    return 0;
 
-  if (0 >= SDLNet_TCP_Recv(sock, data, maxlen)) {
+  if (0 >= (ret = SDLNet_TCP_Recv(sock, data, maxlen))) {
     printError("SDL_net: Failed to receive TCP data.");
-    ret = false;
+    ret = 0;
   }
 
   return ret;
@@ -1266,41 +1302,12 @@ IPaddress* NetManager::queryUDPAddress(UDPsocket sock, int channel) {
   return remote;
 }
 
-/**
- * @brief Allocate and fill a UDPpacket with the given buffer of len bytes.
- *
- * If allocUDPpacket() returns NULL, this function will also return NULL, but
- * without repeating the warning. Make sure to handle NULL packet pointers.
- * @param buf The source buffer.
- * @param len The length of bytes to copy.
- * @return An allocated and filled UDPpacket.
- */
-UDPpacket* NetManager::craftUDPpacket(const char *buf, int len) {
-  UDPpacket *packet;
-  int header;
-
-  if (len > MESSAGE_LENGTH) {
-    printError("NetManager: Message length exceeds current maximum.");
-    return NULL;
-  }
-
-  packet = allocUDPpacket(MESSAGE_LENGTH);
-
-  if (!packet)
-    return NULL;
-
-  packet->len = len;
-  memcpy(packet->data, buf, len);
-
-  return packet;
-}
-
 /**
  * @brief Allocate a new SDL-formatted UDP packet.
  *
  * This is simply an error-checked wrapper of SDLNet_AllocPacket. This should
- * only be called for empty packets receiving data. Packets to be sent should
- * use craftUDPpacket().
+ * only be called for empty packets receiving data. Data to be sent should go
+ * through the buffer form of sendUDP() instead.
  * @param size The number of bytes to allot the buffer portion of the packet.
  * @return The new, empty UDPpacket.
  */
@@ -1369,7 +1376,8 @@ void NetManager::freeUDPpacket(UDPpacket **pack) {
  * @param pack The packet vector to be freed.
  */
 void NetManager::freeUDPpacketV(UDPpacket ***pack) {
-  SDLNet_FreePacketV(*pack);
+  if (*pack)
+    SDLNet_FreePacketV(*pack);
   *pack = NULL;
 }
 
@@ -1391,6 +1399,92 @@ void NetManager::processPacketData(const char *data) {
    */
 }
 
+/**
+ * @brief Queues received data on a peer's output ring.
+ *
+ * A full ring means the game has fallen behind; the message is dropped and
+ * reported rather than overwriting one that has not been read.
+ * @param cData The peer's ClientData.
+ * @param data The received data.
+ * @param len Its length in bytes.
+ */
+void NetManager::queueOutput(ClientData *cData, const void *data, int len) {
+  if (!cData->output.push(data, len))
+    reportDropped(cData->output, "Receive");
+}
+
+/**
+ * @brief Reports the messages a ring has refused since it was last checked.
+ *
+ * The game pushes onto the send rings directly, so the drains in
+ * messageClients() and messageServer() are where its losses come to light.
+ * @param ring The ring to check.
+ * @param name Which ring it is, for the message.
+ */
+void NetManager::reportDropped(MessageRing& ring, const char *name) {
+  int dropped = ring.takeDropped();
+
+  if (dropped) {
+    std::ostringstream ss;
+    ss << "NetManager: " << name << " ring full. Dropped " << dropped
+        << " message(s).";
+    printError(ss.str());
+  }
+}
+
+/**
+ * @brief Appends one message to a batch of TCP frames.
+ *
+ * A frame is the message's length as a big-endian Uint16 followed by the
+ * message itself, so the receiver can find message boundaries however the
+ * stream was segmented.  Batches are sent whole, one send per peer.
+ * @param batch The frames gathered so far.
+ * @param data The message.
+ * @param len Its length in bytes.
+ * @return False, appending nothing, if the message is too long to frame.
+ */
+bool NetManager::frameTCP(std::string& batch, const void *data, int len) {
+  Uint8 header[FRAME_HEADER];
+
+  if (len < 0 || len > MessageRing::MAX_LENGTH) {
+    printError("NetManager: Message length exceeds current maximum.");
+    return false;
+  }
+
+  SDLNet_Write16(len, header);
+  batch.append((const char *) header, FRAME_HEADER);
+  batch.append((const char *) data, len);
+
+  return true;
+}
+
+/**
+ * @brief Queues every whole frame in a peer's TCP stream.
+ *
+ * Whatever follows the last whole frame stays in the stream until the next
+ * read completes it.
+ * @param cData The peer's ClientData.
+ */
+void NetManager::unframeTCP(ClientData *cData) {
+  std::string& stream = cData->stream;
+  const char *data = stream.data();
+  int avail = stream.size();
+  int used = 0;
+  int len;
+
+  while (avail - used >= FRAME_HEADER) {
+    len = SDLNet_Read16((void *) (data + used));
+
+    if (avail - used - FRAME_HEADER < len)
+      break;
+
+    queueOutput(cData, data + used + FRAME_HEADER, len);
+    used += FRAME_HEADER + len;
+  }
+
+  stream.erase(0, used);
+}
+
 /**
  * @brief Register a TCP socket to be watched for activity by SDL.
  * @param sock The socket to watch.
@@ -1431,8 +1525,8 @@ void NetManager::unwatchSocket(UDPsocket sock) {
  * @brief Ask SDL to scan registered sockets once or for a given time period.
  *
  * This function will automatically handle all activity discovered on TCP and
- * UDP. New clients will be added, and data will be copied to the ClientData
- * buffers. <em>The user should check the ClientData arrays after calling this
+ * UDP. New clients will be added, and data will be queued on the ClientData
+ * rings. <em>The user should drain the ClientData rings after calling this
  * function!</em>  Excess or unwanted clients will be rejected.
  * @param timeout_ms The time to scan in milliseconds. 0 is instant.
  * @return True if there was activity, false if there was not.
@@ -1496,12 +1590,15 @@ int NetManager::checkSockets(Uint32 timeout_ms) {
 }
 
 /**
- * @brief Receives a TCP socket and copies its data to the ClientData buffer.
+ * @brief Receives a TCP socket and queues its data on the ClientData ring.
+ *
+ * One read takes whatever the stream has ready, which may be several frames
+ * or part of one; unframeTCP() sorts it out.
  * @param clientIdx An index into the tcpClients vector.
  */
 void NetManager::readTCPSocket(int clientIdx) {
-  bool result;
-  int idxSocket;
+  int result, idxSocket;
+  char buf[TCP_READ_LENGTH];
   ClientData *cData;
 
   if (clientIdx == SOCKET_SELF) {
@@ -1512,10 +1609,7 @@ void NetManager::readTCPSocket(int clientIdx) {
     cData = tcpClientData[netClients[clientIdx]->tcpDataIdx];
   }
 
-  memset(cData->output, 0, MESSAGE_LENGTH);
-
-  result = recvTCP(tcpSockets[idxSocket], cData->output,
-      MESSAGE_LENGTH);
+  result = recvTCP(tcpSockets[idxSocket], buf, TCP_READ_LENGTH);
 
   if (!result) {
     printError("NetManager: Failed to read TCP packet.");
@@ -1525,16 +1619,18 @@ void NetManager::readTCPSocket(int clientIdx) {
       dropClient(PROTOCOL_ALL, cData->host);
     }
   } else {
-    cData->updated = true;
+    cData->stream.append(buf, result);
+    unframeTCP(cData);
   }
 }
 
 /**
- * @brief Receives a UDP socket and copies its data to the ClientData buffer.
+ * @brief Receives a UDP socket and queues its data on the ClientData rings.
  *
  * Because many channels may be bound to a single socket, the vector versions
  * of UDPpacket and udpRecv are used to gather anything and everything that
- * might arrive in one sweep of the socket. New clients are added, if possible.
+ * might arrive in one sweep of the socket, into the socket's preallocated
+ * packet pool. New clients are added, if possible.
  * @param clientIdx An index into the udpClients vector.
  */
 int NetManager::readUDPSocket(int clientIdx) {
@@ -1543,11 +1639,14 @@ int NetManager::readUDPSocket(int clientIdx) {
   ConnectionInfo *client;
   int idxSocket, numPackets, ret, i;
 
-  cData = udpServerData;
+  cData = &udpServerData;
   idxSocket = (clientIdx == SOCKET_SELF) ? netServer.udpSocketIdx :
       netClients[clientIdx]->udpSocketIdx;
 
-  bufV = allocUDPpacketV(MESSAGE_COUNT, MESSAGE_LENGTH);
+  bufV = udpPacketPools[idxSocket];
+
+  if (!bufV)
+    return 0;
 
   numPackets = recvUDPV(udpSockets[idxSocket], bufV);
 
@@ -1565,24 +1664,22 @@ int NetManager::readUDPSocket(int clientIdx) {
           if (netStatus & NET_CLIENT)
             printError("NetManager: Invalid packet source.");
           ret--;
-        } else if (0 == STR_DENY.compare((const char *) bufV[i]->data)) {
+        } else if (bufV[i]->len == STR_DENY.length() &&
+            !memcmp(bufV[i]->data, STR_DENY.data(), bufV[i]->len)) {
           // Received rejection packet.  Don't process it (for now).
           ret--;
         } else if (!addUDPClient(bufV[i])) {
           // Try to add the client; if not, at least copy the data.
-          memcpy(cData[i].output, bufV[i]->data, bufV[i]->len);
-          cData[i].updated = true;
+          queueOutput(cData, bufV[i]->data, bufV[i]->len);
         }
       } else {                                               // Bound sender.
         if (netStatus & NET_CLIENT) {
           // Message comes from server, cData default is good (above).
-          memcpy(cData[i].output, bufV[i]->data, bufV[i]->len);
-          cData[i].updated = true;
+          queueOutput(cData, bufV[i]->data, bufV[i]->len);
         } else if ((client = lookupClient(bufV[i]->address.host, false))) {
           // Message comes from client, lookup new cData.
-          cData = udpClientData[client->udpDataIdx];
-          memcpy(cData->output, bufV[i]->data, bufV[i]->len);
-          cData->updated = true;
+          queueOutput(udpClientData[client->udpDataIdx], bufV[i]->data,
+              bufV[i]->len);
         } else {
           printError("NetManager: Failed to look up existing client.");
           ret--;
@@ -1592,9 +1689,6 @@ int NetManager::readUDPSocket(int clientIdx) {
     }
   }
 
-  if (bufV)
-    freeUDPpacketV(&bufV);
-
   return ret;
 }
 
@@ -1629,8 +1723,7 @@ bool NetManager::addUDPClient(UDPpacket *pack) {
 
   if ((client = lookupClient(pack->address.host, false))) {
     cData = udpClientData[client->udpDataIdx];
-    memcpy(cData->output, pack->data, pack->len);
-    cData->updated = true;
+    queueOutput(cData, pack->data, pack->len);
   }
 
   printError("New UDP client registered!");
@@ -1645,7 +1738,9 @@ bool NetManager::addUDPClient(UDPpacket *pack) {
  * @param sock The rejectee's associated socket.
  */
 void NetManager::rejectTCPClient(TCPsocket sock) {
-  sendTCP(sock, STR_DENY.c_str(), STR_DENY.length());
+  tcpBatch.clear();
+  frameTCP(tcpBatch, STR_DENY.data(), STR_DENY.length());
+  sendTCP(sock, tcpBatch.data(), tcpBatch.size());
 
   closeTCP(sock);
 }
@@ -1657,12 +1752,8 @@ void NetManager::rejectTCPClient(TCPsocket sock) {
  * @param pack The rejectee's associated packet.
  */
 void NetManager::rejectUDPClient(UDPpacket *pack) {
-  UDPpacket *packet;
-
-  packet = craftUDPpacket(STR_DENY.c_str(), STR_DENY.length());
-  packet->address.host = pack->address.host;
-  packet->address.port = pack->address.port;
-  sendUDP(udpSockets[netServer.udpSocketIdx], -1, packet);
+  sendUDP(udpSockets[netServer.udpSocketIdx], -1, STR_DENY.c_str(),
+      STR_DENY.length(), &pack->address);
 }
 
 /**
@@ -1796,6 +1887,10 @@ void NetManager::resetManager() {
     delete netClients[i];
     netClients.pop_back();
   }
+  for (i = udpPacketPools.size() - 1; i >= 0; i--) {
+    freeUDPpacketV(&udpPacketPools[i]);
+    udpPacketPools.pop_back();
+  }
   SDLNet_FreeSocketSet(socketNursery);
 
   forceClientRandomUDP = true;
@@ -35,6 +35,7 @@
 #include <sstream>
 #include <iostream>
 #include "SDLnet/SDL_net.h"
+#include "MessageRing.h"
 
 
 /* ****************************************************************************
@@ -73,16 +74,18 @@ struct ConnectionInfo {
 };
 
 /**
- * External bins to which all received data is output and from which data may
- * be automatically pulled as input.
- * \b The \b user \b is \b responsible \b for \b clearing \b the \b updated
- * \b flag \b when \b data \b is \b retrieved!
+ * External queues, one per peer and protocol, to which all received data is
+ * output and from which data may be automatically pulled as input.
+ * \b The \b user \b consumes \b each \b message \b with \b pop() \b once
+ * \b handled!  Messages queue up in arrival order until then.  Each keeps its
+ * own length, and a staged UDP message is sent at that length, so small
+ * updates make small datagrams.
  */
 struct ClientData {
   Uint32 host;                        //!< To differentiate bin owners.
-  bool updated;                       //!< Indicates new network output.
-  char output[128];                   //!< Received network data.
-  char input[128];                    //!< Target for automatic data pulls.
+  MessageRing output;                 //!< Received network data.
+  MessageRing input;                  //!< Data for messageClients/Server to send.
+  std::string stream;                 //!< TCP bytes not yet forming a whole frame.
 };
 
 /**
@@ -117,9 +120,9 @@ static const Uint32 UINT_BLSHT(0xFF0001FF);
  * While parameters may be given, the class is initialized to a default of
  * both TCP and UDP active on port 51215. Fully managed state preservation
  * prevents users from initiating illegal or undefined calls.  All retrieved
- * data is tunneled to public bins which must or may be checked by users.
- * Data to be sent may be specified or else is retrieved by default from the
- * established MessageBuffer bin.
+ * data is queued in public per-peer rings which users drain as they go.
+ * Data to be sent may be specified or else is drained by default from the
+ * established ClientData input rings.
  *
  * I've worked rather hard to eliminate dependency on Ogre3d-specific code so
  * that any application using SDL_net can plug this in and go.  I've done my
@@ -187,7 +190,7 @@ public:
   //! @}
 
   ClientData tcpServerData;
-  ClientData udpServerData[10];
+  ClientData udpServerData;
   std::vector<ClientData *> tcpClientData;
   std::vector<ClientData *> udpClientData;
 
@@ -221,6 +224,8 @@ private:
     SOCKET_SELF         = SOCKET_ALL_MAX + 1,
     MESSAGE_COUNT       = 10,
     MESSAGE_LENGTH      = 256,
+    FRAME_HEADER        = 2,
+    TCP_READ_LENGTH     = 4096,
     MASK_DEPTH          = 24
     ///@}
   };
@@ -235,7 +240,9 @@ private:
   void unbindUDPSocket(UDPsocket sock, int channel);
   bool sendTCP(TCPsocket sock, const void *data, int len);
   bool sendUDP(UDPsocket sock, int channel, UDPpacket *pack);
-  bool recvTCP(TCPsocket sock, void *data, int maxlen);
+  bool sendUDP(UDPsocket sock, int channel, const void *data, int len,
+      IPaddress *addr = NULL);
+  int recvTCP(TCPsocket sock, void *data, int maxlen);
   bool recvUDP(UDPsocket sock, UDPpacket *pack);
   bool sendUDPV(UDPsocket sock, UDPpacket **packetV, int npackets);
   int recvUDPV(UDPsocket sock, UDPpacket **packetV);
@@ -246,13 +253,19 @@ private:
   //! @}
 
   /** @name  UDP Packet Management.                                  *////@{
-  UDPpacket* craftUDPpacket(const char *buf, int len);
   UDPpacket* allocUDPpacket(int size);
   UDPpacket** allocUDPpacketV(int count, int size);
   bool resizeUDPpacket(UDPpacket *pack, int size);
   void freeUDPpacket(UDPpacket **pack);
   void freeUDPpacketV(UDPpacket ***pack);
   void processPacketData(const char *data);
+  void queueOutput(ClientData *cData, const void *data, int len);
+  void reportDropped(MessageRing& ring, const char *name);
+  //! @}
+
+  /** @name  TCP Framing.                                            *////@{
+  bool frameTCP(std::string& batch, const void *data, int len);
+  void unframeTCP(ClientData *cData);
   //! @}
 
   /** @name Socket Registration & Handling.                          *////@{
@@ -293,6 +306,8 @@ private:
   std::vector<ConnectionInfo *> netClients;
   std::vector<TCPsocket> tcpSockets;
   std::vector<UDPsocket> udpSockets;
+  std::vector<UDPpacket **> udpPacketPools;   //!< Receive packets, parallel to udpSockets.
+  std::string tcpBatch;                       //!< Frames gathered for one send per peer.
   SDLNet_SocketSet socketNursery;
 };
 
@@ -30,8 +30,12 @@ int main(int argc, char **argv) {
 
   //------------------------------------------------------------------
 
-  if (netMgr->scanForActivity()) {
-    std::string invite = std::string(netMgr->udpServerData.output);
+  int len;
+  const char *msg;
+
+  if (netMgr->scanForActivity() && (msg = netMgr->udpServerData.output.front(&len))) {
+    std::string invite = std::string(msg);
+    netMgr->udpServerData.output.pop();
     if (std::string::npos != invite.find(STR_OPEN)) {
       std::string svrAddr = invite.substr(STR_OPEN.length());
 
@@ -65,8 +69,10 @@ int main(int argc, char **argv) {
   else {
     std::cout << "Received messages:\n" << std::endl;
 
-    std::cout << netMgr->tcpServerData.output << std::endl;
-    std::cout << netMgr->udpServerData.output << std::endl;
+    for (; (msg = netMgr->tcpServerData.output.front(&len)); netMgr->tcpServerData.output.pop())
+      std::cout << msg << std::endl;
+    for (; (msg = netMgr->udpServerData.output.front(&len)); netMgr->udpServerData.output.pop())
+      std::cout << msg << std::endl;
   }
 
   std::cout << "\n\nTest complete.\n" << std::endl;
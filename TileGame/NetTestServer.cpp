@@ -67,16 +67,19 @@ int main(int argc, char **argv) {
   else {
     std::cout << "Received messages:\n" << std::endl;
 
+    const char *msg;
+    int len;
+
     for (i = 0; i < netMgr->tcpClientData.size(); i++) {
-      if (netMgr->tcpClientData[i]->updated) {
-        std::cout << netMgr->tcpClientData[i]->output << std::endl;
-      }
+      MessageRing& ring = netMgr->tcpClientData[i]->output;
+      for (; (msg = ring.front(&len)); ring.pop())
+        std::cout << msg << std::endl;
     }
 
     for (i = 0; i < netMgr->udpClientData.size(); i++) {
-      if (netMgr->udpClientData[i]->updated) {
-        std::cout << netMgr->udpClientData[i]->output << std::endl;
-      }
+      MessageRing& ring = netMgr->udpClientData[i]->output;
+      for (; (msg = ring.front(&len)); ring.pop())
+        std::cout << msg << std::endl;
     }
   }
 
@@ -3,6 +3,10 @@
 Filename:    OgreMotionState.h
 -----------------------------------------------------------------------------
 
+Hands a ball's start transform to Bullet and keeps the last one Bullet set.
+It does not interpolate or touch the scene node: Simulator::syncTransforms()
+places every node between the last two ticks once per frame, so that the
+same code serves Bullet, the sphere engine and the physics thread.
 -----------------------------------------------------------------------------
  */
 #ifndef __OgreMotionState_h_
@@ -28,16 +32,21 @@ public:
     worldTrans = position;
   }
 
+  // The node is left alone here; Simulator copies each tick's transforms
+  // into its own buffer and moves the node once per frame.
   void setWorldTransform(const btTransform& worldTrans) {
-    if(!ogreObject)
-      return;
+    position = worldTrans;
+  }
 
-    btQuaternion rot = worldTrans.getRotation();
-    ogreObject->setOrientation(rot.w(), rot.x(), rot.y(), rot.z());
-    btVector3 pos = worldTrans.getOrigin();
-    ogreObject->setPosition(pos.x(), pos.y(), pos.z());
+  // Moves a recycled motion state to a new node and start transform.
+  void reset(const btTransform& worldTrans, Ogre::SceneNode* object) {
+    ogreObject = object;
     position = worldTrans;
   }
+
+  Ogre::SceneNode* getNode() {
+    return ogreObject;
+  }
 };
 
 #endif // #ifndef __OgreMotionState_h_
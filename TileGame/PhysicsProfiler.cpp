@@ -0,0 +1,159 @@
+#include "PhysicsProfiler.h"
+
+#include <fstream>
+
+
+static const char *phaseNames[PHASE_COUNT] = {
+  "broadphase", "narrowphase", "solver", "integration", "contacts", "sync", "step"
+};
+
+PhysicsProfiler::PhysicsProfiler(int ringSize):
+ring(ringSize > 0 ? ringSize : 1),
+head(0),
+count(0),
+frames(0)
+{
+  for (int i = 0; i < PHASE_COUNT; i++)
+    current.ms[i] = 0;
+  current.frame = 0;
+  current.awake = current.asleep = 0;
+}
+
+PhysicsProfiler::~PhysicsProfiler() {
+
+}
+
+void PhysicsProfiler::beginFrame() {
+  for (int i = 0; i < PHASE_COUNT; i++)
+    current.ms[i] = 0;
+  current.frame = frames;
+  current.awake = current.asleep = 0;
+
+#ifndef BT_NO_PROFILE
+  CProfileManager::Reset();
+#endif
+  clock.reset();
+}
+
+void PhysicsProfiler::addTime(int phase, double ms) {
+  current.ms[phase] += ms;
+}
+
+void PhysicsProfiler::setActivity(int awake, int asleep) {
+  current.awake = awake;
+  current.asleep = asleep;
+}
+
+void PhysicsProfiler::endFrame() {
+  current.ms[PHASE_STEP] = clock.getTimeMicroseconds() / 1000.0;
+  collectBulletTimes(current);
+
+  ring[head] = current;
+  head = (head + 1) % ring.size();
+  if (count < (int) ring.size())
+    count++;
+  frames++;
+}
+
+/* Walks Bullet's profile tree and files the blocks we know by name under
+ * their phase.  A matched block's children are not visited, so nothing is
+ * counted twice.  Names that a Bullet version lacks simply stay at zero. */
+static void collectNode(CProfileIterator *it, ProfileSample& sample) {
+  int children = 0;
+
+  for (it->First(); !it->Is_Done(); it->Next())
+    children++;
+
+  for (int i = 0; i < children; i++) {
+    int c = 0;
+    for (it->First(); c < i; it->Next())
+      c++;
+
+    std::string name = it->Get_Current_Name();
+    double ms = it->Get_Current_Total_Time();
+
+    if (name == "updateAabbs" || name == "calculateOverlappingPairs")
+      sample.ms[PHASE_BROADPHASE] += ms;
+    else if (name == "dispatchAllCollisionPairs")
+      sample.ms[PHASE_NARROWPHASE] += ms;
+    else if (name == "solveConstraints")
+      sample.ms[PHASE_SOLVER] += ms;
+    else if (name == "integrateTransforms" || name == "predictUnconstraintMotion")
+      sample.ms[PHASE_INTEGRATION] += ms;
+    else {
+      it->Enter_Child(i);
+      collectNode(it, sample);
+      it->Enter_Parent();
+    }
+  }
+}
+
+void PhysicsProfiler::collectBulletTimes(ProfileSample& sample) {
+#ifndef BT_NO_PROFILE
+  CProfileIterator *it = CProfileManager::Get_Iterator();
+  collectNode(it, sample);
+  CProfileManager::Release_Iterator(it);
+#endif
+}
+
+const ProfileSample& PhysicsProfiler::getLastSample() {
+  return ring[(head + ring.size() - 1) % ring.size()];
+}
+
+/* Mean of every sample in the ring. */
+ProfileSample PhysicsProfiler::getAverage() {
+  ProfileSample avg;
+  avg.frame = frames;
+  avg.awake = avg.asleep = 0;
+
+  for (int i = 0; i < count; i++) {
+    avg.awake += ring[i].awake;
+    avg.asleep += ring[i].asleep;
+  }
+  if (count) {
+    avg.awake /= count;
+    avg.asleep /= count;
+  }
+
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    avg.ms[p] = 0;
+    for (int i = 0; i < count; i++)
+      avg.ms[p] += ring[i].ms[p];
+    if (count)
+      avg.ms[p] /= count;
+  }
+
+  return avg;
+}
+
+int PhysicsProfiler::getNumSamples() {
+  return count;
+}
+
+/* Writes the ring oldest sample first, one row per frame. */
+bool PhysicsProfiler::writeCsv(const std::string& path) {
+  std::ofstream out(path.c_str());
+  if (!out)
+    return false;
+
+  out << "frame";
+  for (int p = 0; p < PHASE_COUNT; p++)
+    out << "," << phaseNames[p] << "_ms";
+  out << ",awake,asleep" << std::endl;
+
+  int start = (head + ring.size() - count) % ring.size();
+  for (int i = 0; i < count; i++) {
+    const ProfileSample& s = ring[(start + i) % ring.size()];
+
+    out << s.frame;
+    for (int p = 0; p < PHASE_COUNT; p++)
+      out << "," << s.ms[p];
+    out << "," << s.awake << "," << s.asleep << std::endl;
+  }
+
+  return true;
+}
+
+const char* PhysicsProfiler::getPhaseName(int phase) {
+  return phase >= 0 && phase < PHASE_COUNT ? phaseNames[phase] : "";
+}
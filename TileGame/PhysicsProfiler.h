@@ -0,0 +1,69 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    PhysicsProfiler.h
+-----------------------------------------------------------------------------
+
+Per-frame physics timings.  Bullet's own profiler supplies the broadphase,
+narrowphase, solver and integration times; the simulator adds its contact
+handling and scene sync, and the whole simulateStep() is timed from
+beginFrame() to endFrame().  Each sample also counts the balls that were
+awake and asleep, to show how much of a step went to balls that moved.
+Samples are kept in a ring that can be written out as CSV.
+-----------------------------------------------------------------------------
+ */
+#ifndef __PhysicsProfiler_h_
+#define __PhysicsProfiler_h_
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/LinearMath/btQuickprof.h>
+#include <string>
+#include <vector>
+
+
+enum ProfilePhase {
+  PHASE_BROADPHASE,
+  PHASE_NARROWPHASE,
+  PHASE_SOLVER,
+  PHASE_INTEGRATION,
+  PHASE_CONTACTS,                     // contact harvesting and game hit checks.
+  PHASE_SYNC,                         // pushing transforms to scene nodes.
+  PHASE_STEP,                         // all of simulateStep().
+  PHASE_COUNT
+};
+
+struct ProfileSample {
+  unsigned long frame;
+  double ms[PHASE_COUNT];
+  int awake;                          // balls simulated in the frame's last tick.
+  int asleep;                         // balls Bullet skipped as deactivated.
+};
+
+class PhysicsProfiler {
+public:
+  PhysicsProfiler(int ringSize = 600);
+  virtual ~PhysicsProfiler();
+
+  void beginFrame();
+  void addTime(int phase, double ms);
+  void setActivity(int awake, int asleep);
+  void endFrame();
+
+  const ProfileSample& getLastSample();
+  ProfileSample getAverage();
+  int getNumSamples();
+  bool writeCsv(const std::string& path);
+
+  static const char* getPhaseName(int phase);
+
+private:
+  void collectBulletTimes(ProfileSample& sample);
+
+  std::vector<ProfileSample> ring;
+  int head;                           // next slot to write.
+  int count;
+  unsigned long frames;
+  ProfileSample current;
+  btClock clock;
+};
+
+#endif // #ifndef __PhysicsProfiler_h_
@@ -0,0 +1,227 @@
+#include "PhysicsThread.h"
+
+
+PhysicsThread::PhysicsThread(TileSimulator *sim, BallManager *ballMgr):
+sim(sim),
+ballMgr(ballMgr),
+thread(0),
+mutex(0),
+tickUs(0),
+stopping(0),
+pendingHits(0),
+pendingCollisions(0),
+retiring(0),
+publishedTick(0),
+generation(0),
+shownTick(0)
+{
+  mutex = SDL_CreateMutex();
+}
+
+PhysicsThread::~PhysicsThread() {
+  stop();
+
+  if (mutex)
+    SDL_DestroyMutex(mutex);
+}
+
+/* Hands the simulator to a new thread.  Until stop(), the simulator leaves
+ * the scene nodes to syncNodes() and released balls keep their nodes for
+ * the render thread to destroy. */
+bool PhysicsThread::start() {
+  if (thread)
+    return true;
+  if (!mutex) {
+    std::cerr << "PhysicsThread: Could not create a mutex." << std::endl;
+    return false;
+  }
+
+  tickUs = 1000000 / sim->getTickRate();
+  publishedTick = shownTick = sim->getTickCount();
+  stopping = 0;
+  pendingHits = 0;
+  pendingCollisions = 0;
+  retiring = 0;
+
+  sim->setNodeSync(false);
+  ballMgr->setDeferNodes(true);
+
+  thread = SDL_CreateThread(threadMain, this);
+  if (!thread) {
+    std::cerr << "PhysicsThread: Could not start the physics thread." << std::endl;
+    sim->setNodeSync(true);
+    ballMgr->setDeferNodes(false);
+    return false;
+  }
+
+  return true;
+}
+
+/* Joins the thread and gives the simulator back to the render thread.
+ * Shots still queued are dropped with their nodes. */
+void PhysicsThread::stop() {
+  if (!thread)
+    return;
+
+  stopping = 1;
+  SDL_WaitThread(thread, NULL);
+  thread = NULL;
+
+  ShotInput shot;
+  while (shots.pop(shot))
+    Ball::destroyNode(shot.node);
+
+  sim->setNodeSync(true);
+  ballMgr->setDeferNodes(false);
+}
+
+bool PhysicsThread::isRunning() {
+  return thread != NULL;
+}
+
+/* Stops the physics thread between ticks so the render thread can change
+ * the world.  It holds the thread for a whole step, so only level setup and
+ * teardown and the like should take it; the per-frame path must not. */
+void PhysicsThread::lock() {
+  SDL_mutexP(mutex);
+}
+
+/* Frames taken before released balls' nodes are destroyed may still point
+ * at them, so syncNodes() ignores those frames. */
+void PhysicsThread::unlock() {
+  if (ballMgr->getNumRetiredNodes()) {
+    generation++;
+    ballMgr->destroyRetiredNodes();
+  }
+  SDL_mutexV(mutex);
+}
+
+/* Returns false if the queue is full; the shot is then the caller's. */
+bool PhysicsThread::queueShot(const ShotInput& shot) {
+  return shots.push(shot);
+}
+
+int PhysicsThread::takeHits() {
+  return __sync_fetch_and_and(&pendingHits, 0);
+}
+
+int PhysicsThread::takeBallCollisions() {
+  return __sync_fetch_and_and(&pendingCollisions, 0);
+}
+
+/* The profiler average published with the frame syncNodes() last took.
+ * Returns false if the simulator was not being profiled then. */
+bool PhysicsThread::getProfile(ProfileSample& avg) {
+  const TransformFrame& frame = frames.readSlot();
+
+  if (frame.profiled)
+    avg = frame.profile;
+
+  return frame.profiled;
+}
+
+/* Places the ball nodes from the newest published frame, 'alpha' of the way
+ * from its previous tick to its last by the time since it was published.
+ * Balls that came to rest are placed once more and then left alone.  Runs
+ * on the render thread; returns the number of nodes moved. */
+int PhysicsThread::syncNodes() {
+  if (retiring) {
+    retiring = 0;
+    lock();
+    unlock();
+  }
+
+  frames.acquire();
+  const TransformFrame& frame = frames.readSlot();
+
+  if (frame.generation != generation)
+    return 0;
+
+  btScalar alpha = (btScalar) (clock.getTimeMicroseconds() - frame.published) / tickUs;
+  if (alpha > 1)
+    alpha = 1;
+
+  int synced = 0;
+  std::vector<BodyTransform>::const_iterator it;
+
+  for (it = frame.transforms.begin(); it != frame.transforms.end(); it++) {
+    if (!it->node)
+      continue;
+
+    bool settled = it->position == it->previousPosition && it->rotation == it->previousRotation;
+    if (settled && it->movedTick < shownTick)
+      continue;
+
+    btQuaternion rot = settled ? it->rotation : it->previousRotation.slerp(it->rotation, alpha);
+    btVector3 pos = settled ? it->position : it->previousPosition.lerp(it->position, alpha);
+
+    it->node->setOrientation(rot.w(), rot.x(), rot.y(), rot.z());
+    it->node->setPosition(pos.x(), pos.y(), pos.z());
+    synced++;
+  }
+
+  shownTick = frame.tick;
+
+  return synced;
+}
+
+int PhysicsThread::threadMain(void *data) {
+  static_cast<PhysicsThread *>(data)->run();
+  return 0;
+}
+
+/* Steps the simulator by wall clock time, then sleeps off what is left of
+ * the tick.  The simulator's accumulator absorbs the sleep's coarseness. */
+void PhysicsThread::run() {
+  unsigned long long last = clock.getTimeMicroseconds();
+
+  while (!stopping) {
+    unsigned long long now = clock.getTimeMicroseconds();
+
+    SDL_mutexP(mutex);
+    applyShots();
+    sim->simulateStep((now - last) / 1000000.0);
+
+    if (sim->getNumHits())
+      __sync_fetch_and_add(&pendingHits, sim->getNumHits());
+    int collisions = ballMgr->getNumberBallCollisions();
+    if (collisions)
+      __sync_fetch_and_add(&pendingCollisions, collisions);
+    if (sim->getTickCount() != publishedTick)
+      publishTransforms();
+    if (ballMgr->getNumRetiredNodes())
+      retiring = 1;
+    SDL_mutexV(mutex);
+
+    last = now;
+
+    unsigned long long spent = clock.getTimeMicroseconds() - now;
+    if (spent < tickUs)
+      SDL_Delay((tickUs - spent) / 1000);
+  }
+}
+
+/* Shots are stamped here, with the tick they reach the simulator on, and
+ * fire before the next one. */
+void PhysicsThread::applyShots() {
+  ShotInput shot;
+
+  while (shots.pop(shot)) {
+    shot.tick = sim->getTickCount();
+    sim->queueShot(shot);
+  }
+}
+
+void PhysicsThread::publishTransforms() {
+  TransformFrame& frame = frames.writeSlot();
+
+  frame.transforms = sim->getTransforms();
+  frame.tick = publishedTick = sim->getTickCount();
+  frame.generation = generation;
+  frame.profiled = sim->getProfiler() != NULL;
+  if (frame.profiled)
+    frame.profile = sim->getProfiler()->getAverage();
+  frame.published = clock.getTimeMicroseconds();
+
+  frames.publish();
+}
@@ -0,0 +1,174 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    PhysicsThread.h
+-----------------------------------------------------------------------------
+
+Runs a TileSimulator on its own thread at the simulator's tick rate.  Ball
+transforms and profiler averages reach the render thread through a
+lock-free triple buffer, tile hits and ball collisions through counters,
+and shots reach the simulator through a single-producer queue, so on the
+per-frame path neither thread waits for the other.  Anything else that
+touches the simulator or ball manager from the render thread (level setup
+and teardown, pausing, starting and stopping the profiler) must hold
+lock().
+-----------------------------------------------------------------------------
+ */
+#ifndef __PhysicsThread_h_
+#define __PhysicsThread_h_
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+#include <vector>
+
+#include "TileSimulator.h"
+#include "BallManager.h"
+
+const static int SHOT_QUEUE_SIZE = 32;
+
+/* The ball transforms as of one tick. */
+struct TransformFrame {
+  std::vector<BodyTransform> transforms;
+  unsigned long tick;
+  unsigned long generation;           // node generation on the render thread when taken.
+  unsigned long long published;       // microseconds on the thread's clock.
+  bool profiled;                      // 'profile' holds the profiler's average.
+  ProfileSample profile;
+
+  TransformFrame(): tick(0), generation(0), published(0), profiled(false) {}
+};
+
+/* Three slots shared by one writer and one reader.  The writer fills its
+ * slot and swaps it for the spare; the reader swaps the spare for its own
+ * slot only when the spare holds something newer.  Neither side blocks. */
+template <class T>
+class TripleBuffer {
+public:
+  TripleBuffer(): writeIdx(0), spare(1), readIdx(2) {}
+
+  T& writeSlot() {
+    return slots[writeIdx];
+  }
+
+  void publish() {
+    writeIdx = exchange(&spare, writeIdx | FRESH) & INDEX;
+  }
+
+  // Returns true if a newer slot was taken.
+  bool acquire() {
+    if (!(spare & FRESH))
+      return false;
+
+    readIdx = exchange(&spare, readIdx) & INDEX;
+    return true;
+  }
+
+  T& readSlot() {
+    return slots[readIdx];
+  }
+
+private:
+  enum { INDEX = 3, FRESH = 4 };
+
+  // Full barrier, so the slot's contents are visible before its index.
+  static int exchange(volatile int *v, int n) {
+    int old;
+
+    do {
+      old = *v;
+    } while (__sync_val_compare_and_swap(v, old, n) != old);
+
+    return old;
+  }
+
+  T slots[3];
+  int writeIdx;
+  volatile int spare;
+  int readIdx;
+};
+
+/* A fixed ring with one producing and one consuming thread. */
+template <class T, int N>
+class InputQueue {
+public:
+  InputQueue(): head(0), tail(0) {}
+
+  // Returns false if the queue is full.
+  bool push(const T& item) {
+    int next = (tail + 1) % N;
+
+    if (next == head)
+      return false;
+
+    items[tail] = item;
+    __sync_synchronize();
+    tail = next;
+
+    return true;
+  }
+
+  bool pop(T& item) {
+    if (head == tail)
+      return false;
+
+    __sync_synchronize();
+    item = items[head];
+    __sync_synchronize();
+    head = (head + 1) % N;
+
+    return true;
+  }
+
+private:
+  T items[N];
+  volatile int head;
+  volatile int tail;
+};
+
+class PhysicsThread {
+
+public:
+  PhysicsThread(TileSimulator *sim, BallManager *ballMgr);
+  virtual ~PhysicsThread();
+
+  bool start();
+  void stop();
+  bool isRunning();
+
+  void lock();
+  void unlock();
+
+  bool queueShot(const ShotInput& shot);
+  int takeHits();
+  int takeBallCollisions();
+  bool getProfile(ProfileSample& avg);
+  int syncNodes();
+
+private:
+  static int threadMain(void *data);
+  void run();
+  void applyShots();
+  void publishTransforms();
+
+  TileSimulator *sim;
+  BallManager *ballMgr;
+  SDL_Thread *thread;
+  SDL_mutex *mutex;                               // held by the physics thread while it steps.
+  btClock clock;
+  unsigned long long tickUs;                      // microseconds per tick.
+
+  volatile int stopping;
+  volatile int pendingHits;                       // tiles hit since the last takeHits().
+  volatile int pendingCollisions;                 // main ball pairs since takeBallCollisions().
+  volatile int retiring;                          // shots have left nodes to destroy.
+
+  // Written by the physics thread.
+  TripleBuffer<TransformFrame> frames;
+  unsigned long publishedTick;
+
+  // Written by the render thread.
+  InputQueue<ShotInput, SHOT_QUEUE_SIZE> shots;
+  unsigned long generation;                       // bumped whenever ball nodes are destroyed.
+  unsigned long shownTick;                        // tick of the last frame placed.
+};
+
+#endif // #ifndef __PhysicsThread_h_
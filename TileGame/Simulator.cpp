@@ -1,28 +1,193 @@
 #include "Simulator.h"
 
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+
+BodyTag Simulator::wallTag = { ROLE_WALL, NULL };
+
 
 Simulator::Simulator():
+sceneMgr(0),
+profiler(0),
+hashLog(0),
 collisionConfiguration(0),
-dispatcher(0),
 broadphase(0),
+dispatcher(0),
 solver(0),
+solverPool(0),
 dynamicsWorld(0),
-sceneMgr(0)
+sphereWorld(0),
+dirtyStale(false),
+syncedNodes(0),
+awakeBodies(0),
+sleepingBodies(0),
+nodeSync(true),
+fixedStep(1/60.0),
+accumulator(0),
+timeScale(1),
+maxTicks(3),
+ccdRatio(0.5),
+ccdBodies(0),
+tickCount(0)
 {
+  for (int role = 0; role < ROLE_COUNT; role++)
+    collisionMasks[role] = callbackMasks[role] = COL_ALL;
 }
 
+/* Frees the whole world.  The plane bodies are the simulator's own; any
+ * ball still in the world belongs to its Ball and is only taken out. */
 Simulator::~Simulator() {
+  delete sphereWorld;
+
+  if (dynamicsWorld) {
+    for (int i = dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--) {
+      btCollisionObject *obj = dynamicsWorld->getCollisionObjectArray()[i];
+      btRigidBody *body = btRigidBody::upcast(obj);
+
+      dynamicsWorld->removeCollisionObject(obj);
+      if (body && body->getUserPointer() == &wallTag) {
+        delete body->getMotionState();
+        delete body;
+      }
+    }
+  }
 
+  std::map<ShapeKey, CachedShape>::iterator it;
+  for (it = shapeCache.begin(); it != shapeCache.end(); it++)
+    delete it->second.shape;
+  shapeCache.clear();
+
+  delete dynamicsWorld;
+  delete solverPool;
+  delete solver;
+  delete broadphase;
+  delete dispatcher;
+  delete collisionConfiguration;
 }
 
 void Simulator::initSimulator() {
   collisionConfiguration = new btDefaultCollisionConfiguration();
+
+  // Bullet keeps the sleep timeout in globals, so the last world set up
+  // decides it for every world in the process.
+  gDeactivationTime = config.sleepTime;
+  gDisableDeactivation = config.sleepTime <= 0;
+
+  // Worker threads split islands in whatever order they finish.
+  if (config.deterministic && config.threads > 1) {
+    std::cout << "Simulator: Deterministic mode. Using one thread." << std::endl;
+    config.threads = 1;
+  }
+
+  // The Bullet world still holds every body, for filtering and bookkeeping,
+  // but is never stepped.
+  if (config.engine == ENGINE_SPHERES) {
+    if (config.threads > 1)
+      std::cout << "Simulator: The sphere engine uses one thread." << std::endl;
+    config.threads = 1;
+    sphereWorld = new SphereWorld();
+  } else
+    config.engine = ENGINE_BULLET;
+
+  if (config.broadphase == BROADPHASE_SAP) {
+    if (config.worldExtent <= 0)
+      config.worldExtent = 10000;
+    btVector3 extent(config.worldExtent, config.worldExtent, config.worldExtent);
+    broadphase = new btAxisSweep3(-extent, extent);
+  } else {
+    config.broadphase = BROADPHASE_DBVT;
+    broadphase = new btDbvtBroadphase();
+  }
+
+#ifdef BT_THREADSAFE
+  if (config.threads > 1) {
+    // One scheduler serves every world in the process; Bullet caps the
+    // thread count at what the scheduler supports.
+    static btITaskScheduler *scheduler = btCreateDefaultTaskScheduler();
+
+    if (scheduler) {
+      if (config.solver != SOLVER_SEQUENTIAL)
+        std::cout << "Simulator: The multithreaded world uses sequential impulse." << std::endl;
+      config.solver = SOLVER_SEQUENTIAL;
+
+      scheduler->setNumThreads(config.threads);
+      btSetTaskScheduler(scheduler);
+      config.threads = scheduler->getNumThreads();
+
+      btConstraintSolverPoolMt *pool = new btConstraintSolverPoolMt(config.threads);
+      dispatcher = new btCollisionDispatcherMt(collisionConfiguration, 40);
+      solver = new btSequentialImpulseConstraintSolverMt();
+      solverPool = pool;
+
+      dynamicsWorld = new btDiscreteDynamicsWorldMt(dispatcher, broadphase, pool, solver, collisionConfiguration);
+      dynamicsWorld->setGravity(btVector3(0, 0, 0));
+      applySolverConfig();
+      return;
+    }
+
+    std::cout << "Simulator: No task scheduler available. Using one thread." << std::endl;
+  }
+#else
+  if (config.threads > 1)
+    std::cout << "Simulator: Built without BT_THREADSAFE. Using one thread." << std::endl;
+#endif
+  config.threads = 1;
+
   dispatcher = new btCollisionDispatcher(collisionConfiguration);
-  broadphase = new btDbvtBroadphase();
-  solver = new btSequentialImpulseConstraintSolver();
+
+  if (config.solver == SOLVER_NNCG) {
+#if BT_BULLET_VERSION >= 283
+    solver = new btNNCGConstraintSolver();
+#else
+    std::cout << "Simulator: NNCG needs Bullet 2.83 or later. Using sequential impulse." << std::endl;
+    config.solver = SOLVER_SEQUENTIAL;
+#endif
+  }
+  if (config.solver != SOLVER_NNCG) {
+    config.solver = SOLVER_SEQUENTIAL;
+    solver = new btSequentialImpulseConstraintSolver();
+  }
 
   dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
   dynamicsWorld->setGravity(btVector3(0, 0, 0));
+  applySolverConfig();
+}
+
+void Simulator::applySolverConfig() {
+  btContactSolverInfo& info = dynamicsWorld->getSolverInfo();
+
+  if (config.solverIterations < 1)
+    config.solverIterations = 1;
+  info.m_numIterations = config.solverIterations;
+  info.m_splitImpulse = config.splitImpulse;
+
+  if (sphereWorld)
+    sphereWorld->setIterations(config.solverIterations);
+
+  // Same constraint order every run.
+  if (config.deterministic) {
+    info.m_solverMode &= ~SOLVER_RANDMIZE_ORDER;
+    solver->setRandSeed(0);
+  }
+}
+
+void Simulator::setPhysicsConfig(const PhysicsConfig& cfg) {
+  config = cfg;
+}
+
+const PhysicsConfig& Simulator::getPhysicsConfig() {
+  return config;
+}
+
+bool Simulator::isMultithreaded() {
+  return solverPool != NULL;
+}
+
+/* NULL unless the world runs on the sphere engine. */
+SphereWorld* Simulator::getSphereWorld() {
+  return sphereWorld;
 }
 
 void Simulator::createBounds(const int offset) {
@@ -34,60 +199,324 @@ void Simulator::createBounds(const int offset) {
   addPlaneBound(0, 0, -1, -offset);
 }
 
-bool Simulator::simulateStep(double delay) {
-  bool ret = true;
-  int nSteps = 3;
+/* Advances the world by 'elapsed' seconds of frame time using whole ticks of
+ * fixedStep, so every step Bullet sees has the same length regardless of the
+ * frame rate or time scale.  At most maxTicks ticks are run per call; any
+ * backlog beyond that is dropped rather than carried into the next frame.
+ * A deterministic world carries up to maxTicks more, so short stalls are
+ * caught up; its results depend on the ticks inputs are stamped with, not
+ * on how much wall time is kept.  Ball scene nodes are then placed between
+ * the last two ticks. */
+bool Simulator::simulateStep(double elapsed) {
+  int ticks = 0;
 
-  ret = ret && dynamicsWorld->stepSimulation((1/60.f) - delay, nSteps);
+  if (elapsed > 0)
+    accumulator += elapsed * timeScale;
 
-  return ret;
+  while (accumulator >= fixedStep && ticks < maxTicks) {
+    accumulator -= fixedStep;
+    ticks++;
+  }
+
+  if (config.deterministic) {
+    if (accumulator > maxTicks * fixedStep)
+      accumulator = maxTicks * fixedStep;
+  } else if (accumulator >= fixedStep)
+    accumulator = fmod(accumulator, fixedStep);
+
+  return runTicks(ticks, accumulator < fixedStep ? accumulator / fixedStep : 1);
 }
 
-void Simulator::addPlaneBound(int x, int y, int z, int d) {
-  btCollisionShape* groundShape = new btStaticPlaneShape(btVector3(x, y, z), d);
-  btDefaultMotionState* groundMotionState = new btDefaultMotionState(btTransform(btQuaternion(0, 0, 0, 1), btVector3(0, -1, 0)));
-  btRigidBody::btRigidBodyConstructionInfo groundRigidBodyCI(0, groundMotionState, groundShape, btVector3(0, 0, 0));
-  btRigidBody* groundRigidBody = new btRigidBody(groundRigidBodyCI);
+/* Advances the world by exactly 'n' ticks whatever the frame time, and
+ * shows the last one.  Drivers that apply input at exact ticks, such as a
+ * deterministic replay, step with this instead of simulateStep(). */
+bool Simulator::simulateTicks(int n) {
+  return runTicks(n > 0 ? n : 0, 1);
+}
 
-  groundRigidBody->setRestitution(1.0);
-  groundRigidBody->setCollisionFlags(groundRigidBody->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
-  dynamicsWorld->addRigidBody(groundRigidBody);
+/* Runs 'n' ticks, leaving their contacts in getContactEvents(), and then
+ * places the nodes 'alpha' of the way into the last one. */
+bool Simulator::runTicks(int n, btScalar alpha) {
+  contactEvents.clear();
+
+  for (int i = 0; i < n; i++)
+    tick();
+
+  if (profiler)
+    profiler->setActivity(awakeBodies, sleepingBodies);
+
+  if (!nodeSync)
+    return n > 0;
+
+  if (profiler) {
+    btClock timer;
+    syncTransforms(alpha);
+    profiler->addTime(PHASE_SYNC, timer.getTimeMicroseconds() / 1000.0);
+  } else
+    syncTransforms(alpha);
+
+  return n > 0;
+}
+
+/* One fixed-length step.  Bullet's own motion state interpolation differs
+ * between versions, so the exact post-step transforms are recorded here. */
+void Simulator::tick() {
+  if (sphereWorld) {
+    sphereWorld->step(dynamicBodies, fixedStep, profiler);
+  } else {
+    updateCcd();
+    dynamicsWorld->stepSimulation(fixedStep, 1, fixedStep);
+  }
+  tickCount++;
+
+  recordTransforms();
+
+  if (hashLog)
+    hashLog->record(tickCount, dynamicBodies);
+
+  if (profiler) {
+    btClock timer;
+    harvestContacts();
+    profiler->addTime(PHASE_CONTACTS, timer.getTimeMicroseconds() / 1000.0);
+  } else
+    harvestContacts();
 }
 
-btRigidBody* Simulator::addBoxShape(Ogre::SceneNode* node, int xsize, int ysize, int zsize)  {
-  btCollisionShape* boxShape = new btBoxShape(btVector3(xsize, ysize, zsize));
+/* Copies each awake ball's transform into the buffer, marks the ones that
+ * moved and lists the dirty ones for syncTransforms().  Sleeping balls are
+ * only counted.  Nothing in the scene graph is touched until the sync. */
+void Simulator::recordTransforms() {
+  awakeBodies = sleepingBodies = 0;
+  dirtyBodies.clear();
+  dirtyStale = false;
 
-  btDefaultMotionState* boxMotionState = new btDefaultMotionState(btTransform(btQuaternion(0, 0, 0, 1),
-      btVector3(node->_getDerivedPosition().x, node->_getDerivedPosition().y, node->_getDerivedPosition().z)));
+  for (size_t i = 0; i < dynamicBodies.size(); i++) {
+    btRigidBody *body = dynamicBodies[i];
+    BodyTransform& t = transforms[i];
 
-  btRigidBody::btRigidBodyConstructionInfo boxRigidBodyCI(0, boxMotionState, boxShape, btVector3(0, 0, 0));
-  btRigidBody* boxRigidBody = new btRigidBody(boxRigidBodyCI);
+    t.previousPosition = t.position;
+    t.previousRotation = t.rotation;
 
-  boxRigidBody->setRestitution(1.0);
-  boxRigidBody->setCollisionFlags(boxRigidBody->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
-  dynamicsWorld->addRigidBody(boxRigidBody);
+    if (!body->isActive()) {
+      sleepingBodies++;
+      if (t.dirty)
+        dirtyBodies.push_back(i);
+      continue;
+    }
+    awakeBodies++;
 
-  collisionShapes.push_back(boxShape);
+    const btTransform& xf = body->getCenterOfMassTransform();
+    t.position = xf.getOrigin();
+    t.rotation = xf.getRotation();
 
-  return boxRigidBody;
+    if (t.position != t.previousPosition || t.rotation != t.previousRotation) {
+      t.dirty = true;
+      t.movedTick = tickCount;
+    }
+    if (t.dirty)
+      dirtyBodies.push_back(i);
+  }
+}
+
+/* Walks the dispatcher's manifolds once the step is over and records one
+ * event per pair that any role asked to hear about and that was not already
+ * touching last tick.  This runs on the calling thread even in a
+ * multithreaded world. */
+void Simulator::harvestContacts() {
+  touchingPairs.clear();
+
+  if (sphereWorld) {
+    harvestSphereContacts();
+  } else {
+    int numManifolds = dispatcher->getNumManifolds();
+
+    for (int i = 0; i < numManifolds; i++) {
+      btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(i);
+      int numContacts = manifold->getNumContacts();
+
+      if (!numContacts || !needsCallback(manifold->getBody0(), manifold->getBody1()))
+        continue;
+
+      int best = -1;
+      for (int j = 0; j < numContacts; j++) {
+        const btManifoldPoint& pt = manifold->getContactPoint(j);
+
+        if (pt.getDistance() > 0 && pt.getAppliedImpulse() <= 0)
+          continue;
+        if (best < 0 || pt.getAppliedImpulse() > manifold->getContactPoint(best).getAppliedImpulse())
+          best = j;
+      }
+
+      if (best < 0)
+        continue;
+
+      const btManifoldPoint& pt = manifold->getContactPoint(best);
+      addContact(manifold->getBody0(), manifold->getBody1(), pt.getAppliedImpulse(),
+          pt.getPositionWorldOnA());
+    }
+  }
+
+  std::sort(touchingPairs.begin(), touchingPairs.end());
+  lastTouchingPairs.swap(touchingPairs);
+}
+
+/* The sphere engine's contacts, by the same masks.  Its balls are indexed
+ * in dynamicBodies order. */
+void Simulator::harvestSphereContacts() {
+  const std::vector<SphereContact>& contacts = sphereWorld->getContacts();
+  std::vector<SphereContact>::const_iterator it;
+
+  for (it = contacts.begin(); it != contacts.end(); it++) {
+    const btCollisionObject *body0 = dynamicBodies[it->ball0];
+    const btCollisionObject *body1 = it->ball1 >= 0 ? dynamicBodies[it->ball1] : sphereWorld->getPlane(it->plane).body;
+
+    if (needsCallback(body0, body1))
+      addContact(body0, body1, it->impulse, it->position);
+  }
+}
+
+/* Notes a touching pair and records an event for it unless it was already
+ * touching last tick.  A pair may turn up more than once in one tick. */
+void Simulator::addContact(const btCollisionObject *body0, const btCollisionObject *body1,
+    btScalar impulse, const btVector3& position) {
+  BodyPair pair = body0 < body1 ? BodyPair(body0, body1) : BodyPair(body1, body0);
+
+  touchingPairs.push_back(pair);
+
+  if (std::binary_search(lastTouchingPairs.begin(), lastTouchingPairs.end(), pair))
+    return;
+  lastTouchingPairs.insert(std::lower_bound(lastTouchingPairs.begin(), lastTouchingPairs.end(), pair), pair);
+
+  ContactEvent event;
+  event.body0 = body0;
+  event.body1 = body1;
+  event.impulse = impulse;
+  event.position = position;
+  event.tick = tickCount;
+  contactEvents.push_back(event);
+}
+
+/* Turns on continuous collision detection for balls that would cover more
+ * than ccdRatio of their radius this tick, and off again once they slow
+ * down.  A charged shot can otherwise end a tick past a boundary plane and
+ * be pushed out the far side, while the slow bulk of the balls skips the
+ * sweep. */
+void Simulator::updateCcd() {
+  std::vector<btRigidBody *>::iterator it;
+
+  ccdBodies = 0;
+
+  for (it = dynamicBodies.begin(); it != dynamicBodies.end(); it++) {
+    btRigidBody *body = *it;
+    btScalar radius = static_cast<btSphereShape *>(body->getCollisionShape())->getRadius();
+    btScalar threshold = radius * ccdRatio;
+    bool fast = ccdRatio > 0 && body->getLinearVelocity().length() * fixedStep > threshold;
+
+    if (fast) {
+      if (body->getCcdMotionThreshold() != threshold) {
+        body->setCcdMotionThreshold(threshold);
+        body->setCcdSweptSphereRadius(radius * 0.8);
+      }
+      ccdBodies++;
+    } else if (body->getCcdMotionThreshold() > 0) {
+      body->setCcdMotionThreshold(0);
+      body->setCcdSweptSphereRadius(0);
+    }
+  }
+}
+
+/* Places the nodes of balls that moved 'alpha' of the way from the previous
+ * tick to the last, once per frame however many ticks ran.  A ball stays
+ * dirty until its node shows a tick in which it did not move, so only the
+ * dirty list is walked and balls asleep since then cost nothing. */
+void Simulator::syncTransforms(btScalar alpha) {
+  std::vector<int>::iterator it;
+
+  syncedNodes = 0;
+
+  if (dirtyStale) {
+    dirtyBodies.clear();
+    for (size_t j = 0; j < transforms.size(); j++) {
+      if (transforms[j].dirty)
+        dirtyBodies.push_back(j);
+    }
+    dirtyStale = false;
+  }
+
+  for (it = dirtyBodies.begin(); it != dirtyBodies.end(); it++) {
+    BodyTransform *t = &transforms[*it];
+
+    if (!t->dirty)
+      continue;
+
+    bool settled = t->position == t->previousPosition && t->rotation == t->previousRotation;
+
+    if (t->node) {
+      btQuaternion rot = settled ? t->rotation : t->previousRotation.slerp(t->rotation, alpha);
+      btVector3 pos = settled ? t->position : t->previousPosition.lerp(t->position, alpha);
+
+      t->node->setOrientation(rot.w(), rot.x(), rot.y(), rot.z());
+      t->node->setPosition(pos.x(), pos.y(), pos.z());
+      syncedNodes++;
+    }
+
+    if (settled)
+      t->dirty = false;
+  }
+}
+
+/* Adds a ball to the simulated list with a fresh transform slot. */
+void Simulator::trackBody(btRigidBody* body, const btTransform& start) {
+  BodyTransform t;
+
+  t.position = t.previousPosition = start.getOrigin();
+  t.rotation = t.previousRotation = start.getRotation();
+  t.node = static_cast<OgreMotionState *>(body->getMotionState())->getNode();
+  t.dirty = true;
+  t.movedTick = tickCount;
+
+  body->setSleepingThresholds(config.sleepLinear, config.sleepAngular);
+
+  dynamicBodies.push_back(body);
+  transforms.push_back(t);
+  dirtyBodies.push_back(transforms.size() - 1);
+}
+
+void Simulator::addPlaneBound(int x, int y, int z, int d) {
+  btCollisionShape* groundShape = acquireShape(SHAPE_PLANE, x, y, z, d);
+  btDefaultMotionState* groundMotionState = new btDefaultMotionState(btTransform(btQuaternion(0, 0, 0, 1), btVector3(0, -1, 0)));
+  btRigidBody::btRigidBodyConstructionInfo groundRigidBodyCI(0, groundMotionState, groundShape, btVector3(0, 0, 0));
+  btRigidBody* groundRigidBody = new btRigidBody(groundRigidBodyCI);
+
+  groundRigidBody->setRestitution(1.0);
+  groundRigidBody->setUserPointer(&wallTag);
+  addFilteredBody(groundRigidBody);
+
+  if (sphereWorld)
+    sphereWorld->addPlane(groundRigidBody);
 }
 
 btRigidBody* Simulator::addBallShape(Ogre::SceneNode* node, int radius, int mass)  {
+  return addBallShape(node, btVector3(node->_getDerivedPosition().x, node->_getDerivedPosition().y,
+      node->_getDerivedPosition().z), radius, mass);
+}
+
+/* The node may be NULL, in which case the ball is simulated without being
+ * drawn (see TileHeadless). */
+btRigidBody* Simulator::addBallShape(Ogre::SceneNode* node, const btVector3& pos, int radius, int mass)  {
   btVector3 ballInertia(0, 0, 0);
-  btCollisionShape* ballShape = new btSphereShape(radius * 0.9);
+  btCollisionShape* ballShape = acquireShape(SHAPE_SPHERE, radius * 0.9);
   ballShape->calculateLocalInertia(mass, ballInertia);
 
-  OgreMotionState* ballMotionState = new OgreMotionState(btTransform(btQuaternion(0, 0, 0, 1.0),
-      btVector3(node->_getDerivedPosition().x, node->_getDerivedPosition().y, node->_getDerivedPosition().z)), node);
+  btTransform start(btQuaternion(0, 0, 0, 1.0), pos);
+  OgreMotionState* ballMotionState = new OgreMotionState(start, node);
 
   btRigidBody::btRigidBodyConstructionInfo ballRigidBodyCI(mass, ballMotionState, ballShape, ballInertia);
   btRigidBody* ballRigidBody = new btRigidBody(ballRigidBodyCI);
 
   ballRigidBody->setRestitution(1.0);
-  ballRigidBody->setCollisionFlags(ballRigidBody->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
-  dynamicsWorld->addRigidBody(ballRigidBody);
-
-  collisionShapes.push_back(ballShape);
+  addFilteredBody(ballRigidBody);
+  trackBody(ballRigidBody, start);
 
   return ballRigidBody;
 }
@@ -96,6 +525,368 @@ void Simulator::registerCallback(void *func) {
   gContactProcessedCallback = (ContactProcessedCallback) func;
 }
 
+/* Puts a body parked by parkRigidBody() back into the world as a fresh ball:
+ * at rest at 'pos', drawn by 'node', with world gravity and the given radius
+ * and mass.  Saves the allocations addBallShape() would make. */
+btRigidBody* Simulator::reuseBallShape(btRigidBody* body, Ogre::SceneNode* node, const btVector3& pos, int radius, int mass) {
+  btVector3 ballInertia(0, 0, 0);
+  btCollisionShape* ballShape = acquireShape(SHAPE_SPHERE, radius * 0.9);
+  releaseShape(body->getCollisionShape());
+  ballShape->calculateLocalInertia(mass, ballInertia);
+
+  btTransform start(btQuaternion(0, 0, 0, 1.0), pos);
+  static_cast<OgreMotionState *>(body->getMotionState())->reset(start, node);
+
+  body->setCollisionShape(ballShape);
+  body->setMassProps(mass, ballInertia);
+  body->updateInertiaTensor();
+  body->setCenterOfMassTransform(start);
+  body->setLinearVelocity(btVector3(0, 0, 0));
+  body->setAngularVelocity(btVector3(0, 0, 0));
+  body->setInterpolationLinearVelocity(btVector3(0, 0, 0));
+  body->setInterpolationAngularVelocity(btVector3(0, 0, 0));
+  body->clearForces();
+  body->forceActivationState(ACTIVE_TAG);
+  body->setDeactivationTime(0);
+
+  addFilteredBody(body);
+  trackBody(body, start);
+
+  return body;
+}
+
+/* Takes a body out of the world but keeps its motion state and shape so it
+ * can be handed out again by reuseBallShape().  Its contacts are forgotten,
+ * so a reused body's first touch is reported. */
+void Simulator::parkRigidBody(btRigidBody* body) {
+  for (size_t i = 0; i < dynamicBodies.size(); i++) {
+    if (dynamicBodies[i] == body) {
+      dynamicBodies.erase(dynamicBodies.begin() + i);
+      transforms.erase(transforms.begin() + i);
+      dirtyStale = true;
+      break;
+    }
+  }
+
+  for (size_t i = lastTouchingPairs.size(); i > 0; i--) {
+    if (lastTouchingPairs[i - 1].first == body || lastTouchingPairs[i - 1].second == body)
+      lastTouchingPairs.erase(lastTouchingPairs.begin() + i - 1);
+  }
+
+  dynamicsWorld->removeRigidBody(body);
+}
+
+/* Removes a body from the world, deletes its motion state and releases its
+ * shape.  The body itself is still owned by the caller. */
+void Simulator::removeRigidBody(btRigidBody* body) {
+  parkRigidBody(body);
+  delete body->getMotionState();
+  body->setMotionState(NULL);
+  releaseShape(body->getCollisionShape());
+}
+
+/* Per-phase timings are taken while a profiler is set.  The caller keeps
+ * ownership. */
+void Simulator::setProfiler(PhysicsProfiler *prof) {
+  profiler = prof;
+}
+
+PhysicsProfiler* Simulator::getProfiler() {
+  return profiler;
+}
+
+/* While a log is set every tick's world state is hashed into it.  The
+ * caller keeps ownership. */
+void Simulator::setHashLog(StateHashLog *log) {
+  hashLog = log;
+}
+
+StateHashLog* Simulator::getHashLog() {
+  return hashLog;
+}
+
+/* Captures every ball in the world.  'snap' keeps its storage between calls,
+ * so taking snapshots of a level repeatedly does not allocate. */
+void Simulator::saveSnapshot(WorldSnapshot& snap) {
+  snap.bodies.resize(dynamicBodies.size());
+
+  for (size_t i = 0; i < dynamicBodies.size(); i++) {
+    btRigidBody *body = dynamicBodies[i];
+    BodySnapshot& b = snap.bodies[i];
+
+    b.body = body;
+    b.transform = body->getCenterOfMassTransform();
+    b.linearVelocity = body->getLinearVelocity();
+    b.angularVelocity = body->getAngularVelocity();
+    b.gravity = body->getGravity();
+    b.invMass = body->getInvMass();
+    b.deactivationTime = body->getDeactivationTime();
+    b.activationState = body->getActivationState();
+  }
+
+  snap.tiles.clear();
+  snap.touching = lastTouchingPairs;
+  snap.tickCount = tickCount;
+  snap.accumulator = accumulator;
+}
+
+/* Puts every ball in 'snap' back as it was and rewinds the tick count.
+ * Balls added since are left alone; their owner removes them.  Returns
+ * false, changing nothing, if a ball in the snapshot has left the world. */
+bool Simulator::restoreSnapshot(const WorldSnapshot& snap) {
+  std::vector<int> slots(snap.bodies.size());
+  size_t i, j = 0;
+
+  // Balls keep their relative order in dynamicBodies, so one forward pass
+  // finds them all.
+  for (i = 0; i < snap.bodies.size(); i++) {
+    while (j < dynamicBodies.size() && dynamicBodies[j] != snap.bodies[i].body)
+      j++;
+    if (j == dynamicBodies.size())
+      return false;
+    slots[i] = j++;
+  }
+
+  for (i = 0; i < snap.bodies.size(); i++) {
+    const BodySnapshot& b = snap.bodies[i];
+    btRigidBody *body = b.body;
+    BodyTransform& t = transforms[slots[i]];
+    btVector3 inertia(0, 0, 0);
+
+    if (b.invMass > 0)
+      body->getCollisionShape()->calculateLocalInertia(1 / b.invMass, inertia);
+    body->setMassProps(b.invMass > 0 ? 1 / b.invMass : 0, inertia);
+    body->updateInertiaTensor();
+    body->setGravity(b.gravity);
+
+    body->setCenterOfMassTransform(b.transform);
+    body->getMotionState()->setWorldTransform(b.transform);
+    body->setLinearVelocity(b.linearVelocity);
+    body->setAngularVelocity(b.angularVelocity);
+    body->setInterpolationLinearVelocity(b.linearVelocity);
+    body->setInterpolationAngularVelocity(b.angularVelocity);
+    body->clearForces();
+    body->forceActivationState(b.activationState);
+    body->setDeactivationTime(b.deactivationTime);
+
+    // Cached contacts describe the old positions.
+    if (body->getBroadphaseHandle())
+      broadphase->getOverlappingPairCache()->cleanProxyFromPairs(body->getBroadphaseHandle(), dispatcher);
+
+    t.position = t.previousPosition = b.transform.getOrigin();
+    t.rotation = t.previousRotation = b.transform.getRotation();
+    t.dirty = true;
+  }
+
+  tickCount = snap.tickCount;
+  accumulator = snap.accumulator;
+  if (hashLog)
+    hashLog->rewind(tickCount);
+  contactEvents.clear();
+  lastTouchingPairs = snap.touching;
+  dirtyStale = true;
+
+  return true;
+}
+
+/* Adds a body to the world in the collision group of its tag's role.  Only
+ * roles that opted in to contact callbacks get CF_CUSTOM_MATERIAL_CALLBACK. */
+void Simulator::addFilteredBody(btRigidBody* body) {
+  int role = getBodyRole(body);
+
+  if (callbackMasks[role])
+    body->setCollisionFlags(body->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
+  else
+    body->setCollisionFlags(body->getCollisionFlags() & ~btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
+
+  dynamicsWorld->addRigidBody(body, 1 << role, collisionMasks[role]);
+}
+
+/* Moves a body that is already in the world into the group of its tag's
+ * current role, dropping any pairs the new mask no longer allows. */
+void Simulator::applyCollisionFilter(btRigidBody* body) {
+  btBroadphaseProxy* proxy = body->getBroadphaseHandle();
+  int role = getBodyRole(body);
+
+  if (callbackMasks[role])
+    body->setCollisionFlags(body->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
+  else
+    body->setCollisionFlags(body->getCollisionFlags() & ~btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
+
+  if (!proxy)
+    return;
+
+  proxy->m_collisionFilterGroup = 1 << role;
+  proxy->m_collisionFilterMask = collisionMasks[role];
+  broadphase->getOverlappingPairCache()->cleanProxyFromPairs(proxy, dispatcher);
+}
+
+/* Sets the groups bodies of 'role' collide with in this world.  Bullet
+ * checks masks in both directions, so the other roles are updated to match.
+ * Only affects bodies added or refiltered afterwards. */
+void Simulator::setCollisionMask(int role, short mask) {
+  for (int other = 0; other < ROLE_COUNT; other++) {
+    if (mask & (1 << other))
+      collisionMasks[other] |= (1 << role);
+    else
+      collisionMasks[other] &= ~(1 << role);
+  }
+
+  collisionMasks[role] = mask;
+}
+
+/* Sets the partner groups for which contacts involving 'role' are reported
+ * as this world's contact events. */
+void Simulator::setCallbackMask(int role, short mask) {
+  callbackMasks[role] = mask;
+}
+
+/* True if either body's role asked to hear about the other's.  Used to pick
+ * contact events, and by any registered callback of this world, since Bullet
+ * calls gContactProcessedCallback whatever the collision flags. */
+bool Simulator::needsCallback(const void *body0, const void *body1) {
+  int role0 = getBodyRole(body0);
+  int role1 = getBodyRole(body1);
+
+  return (callbackMasks[role0] & (1 << role1)) || (callbackMasks[role1] & (1 << role0));
+}
+
+/* Returns the shared shape for these dimensions, creating it on first use.
+ * Every call must be matched by a releaseShape(). */
+btCollisionShape* Simulator::acquireShape(int type, btScalar a, btScalar b, btScalar c, btScalar d) {
+  ShapeKey key;
+  key.type = type;
+  key.dims[0] = a;
+  key.dims[1] = b;
+  key.dims[2] = c;
+  key.dims[3] = d;
+
+  std::map<ShapeKey, CachedShape>::iterator it = shapeCache.find(key);
+  if (it != shapeCache.end()) {
+    it->second.refs++;
+    return it->second.shape;
+  }
+
+  CachedShape entry;
+  switch (type) {
+  case SHAPE_PLANE:
+    entry.shape = new btStaticPlaneShape(btVector3(a, b, c), d);
+    break;
+  default:
+    entry.shape = new btSphereShape(a);
+    break;
+  }
+  entry.refs = 1;
+  shapeCache[key] = entry;
+
+  return entry.shape;
+}
+
+/* Drops one reference and deletes the shape once nothing uses it. */
+void Simulator::releaseShape(btCollisionShape* shape) {
+  std::map<ShapeKey, CachedShape>::iterator it;
+
+  for (it = shapeCache.begin(); it != shapeCache.end(); it++) {
+    if (it->second.shape == shape) {
+      if (--it->second.refs <= 0) {
+        delete shape;
+        shapeCache.erase(it);
+      }
+      return;
+    }
+  }
+}
+
+int Simulator::getNumShapes() {
+  return shapeCache.size();
+}
+
+void Simulator::setTickRate(int hz) {
+  if (hz > 0)
+    fixedStep = 1.0 / hz;
+}
+
+int Simulator::getTickRate() {
+  return (int) (1.0 / fixedStep + 0.5);
+}
+
+void Simulator::setMaxTicks(int n) {
+  maxTicks = n > 0 ? n : 1;
+}
+
+int Simulator::getMaxTicks() {
+  return maxTicks;
+}
+
+/* Switches deterministic stepping on or off in a running world, e.g. once a
+ * networked game starts.  The thread count is fixed at initSimulator(). */
+void Simulator::setDeterministic(bool on) {
+  config.deterministic = on;
+
+  if (dynamicsWorld)
+    applySolverConfig();
+  setTimeScale(timeScale);
+}
+
+/* Deterministic worlds only pause (0) or run at normal speed. */
+void Simulator::setTimeScale(double scale) {
+  timeScale = scale > 0 ? scale : 0;
+
+  if (config.deterministic && timeScale > 0)
+    timeScale = 1;
+}
+
+double Simulator::getTimeScale() {
+  return timeScale;
+}
+
+/* Sets how far, in ball radii, a ball must move in one tick before it is
+ * swept.  0 disables continuous collision detection. */
+void Simulator::setCcdRatio(double ratio) {
+  ccdRatio = ratio > 0 ? ratio : 0;
+}
+
+double Simulator::getCcdRatio() {
+  return ccdRatio;
+}
+
+int Simulator::getNumCcdBodies() {
+  return ccdBodies;
+}
+
+unsigned long Simulator::getTickCount() {
+  return tickCount;
+}
+
+int Simulator::getNumSyncedNodes() {
+  return syncedNodes;
+}
+
+/* Balls simulated and balls left asleep in the last tick.  Locked balls
+ * sleep as soon as they are locked. */
+int Simulator::getNumAwakeBodies() {
+  return awakeBodies;
+}
+
+int Simulator::getNumSleepingBodies() {
+  return sleepingBodies;
+}
+
+/* With node sync off, ticks still record transforms but never touch the
+ * scene graph; whoever owns the render thread reads getTransforms() and
+ * places the nodes itself. */
+void Simulator::setNodeSync(bool on) {
+  nodeSync = on;
+}
+
+const std::vector<BodyTransform>& Simulator::getTransforms() {
+  return transforms;
+}
+
+const std::vector<ContactEvent>& Simulator::getContactEvents() {
+  return contactEvents;
+}
+
 btDiscreteDynamicsWorld& Simulator::getDynamicsWorld() {
   return *this->dynamicsWorld;
 }
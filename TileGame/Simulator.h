@@ -11,12 +11,181 @@ Filename:    Simulator.h
 #include <bullet/btBulletDynamicsCommon.h>
 #include <OgreSceneManager.h>
 #include <vector>
+#include <map>
+#include <utility>
+
+#ifdef BT_THREADSAFE
+#include <bullet/LinearMath/btThreads.h>
+#include <bullet/BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#endif
+
+#if BT_BULLET_VERSION >= 283
+#include <bullet/BulletDynamics/ConstraintSolver/btNNCGConstraintSolver.h>
+#endif
 
 #include "OgreMotionState.h"
+#include "PhysicsProfiler.h"
+#include "SphereWorld.h"
+#include "StateHashLog.h"
 
 
 extern ContactProcessedCallback gContactProcessedCallback;
 
+enum BroadphaseType {
+  BROADPHASE_DBVT,                    // dynamic AABB trees, unbounded.
+  BROADPHASE_SAP                      // sweep and prune inside +/- worldExtent.
+};
+
+enum SolverType {
+  SOLVER_SEQUENTIAL,                  // btSequentialImpulseConstraintSolver.
+  SOLVER_NNCG                         // nonlinear nonsmooth conjugate gradient (Bullet 2.83+).
+};
+
+enum PhysicsEngine {
+  ENGINE_BULLET,                      // btDiscreteDynamicsWorld.
+  ENGINE_SPHERES                      // SphereWorld: spheres and planes only, for thousands of balls.
+};
+
+/* World construction options.  Read by initSimulator(), so set them first. */
+struct PhysicsConfig {
+  int engine;
+  int threads;                        // > 1 builds a multithreaded world (BT_THREADSAFE builds only).
+  int broadphase;
+  btScalar worldExtent;               // half-size of the sweep and prune bounds.
+  int solver;
+  int solverIterations;
+  bool splitImpulse;                  // resolve penetration without adding velocity.
+  bool deterministic;                 // one thread, fixed solver order, no time scaling.
+  btScalar sleepLinear;               // speed in units per second below which a ball may sleep.
+  btScalar sleepAngular;              // spin in radians per second, likewise.
+  btScalar sleepTime;                 // seconds a ball must stay that slow; 0 never sleeps.
+
+  PhysicsConfig():
+    engine(ENGINE_BULLET),
+    threads(1),
+    broadphase(BROADPHASE_DBVT),
+    worldExtent(0),
+    solver(SOLVER_SEQUENTIAL),
+    solverIterations(10),
+    splitImpulse(false),
+    deterministic(false),
+    sleepLinear(20),
+    sleepAngular(0.5),
+    sleepTime(0.5)
+  {
+  }
+};
+
+enum ShapeType {
+  SHAPE_PLANE,                        // dims: normal x, y, z and plane constant.
+  SHAPE_SPHERE                        // dims: radius.
+};
+
+/* Collision shapes are interned by type and dimensions and shared by every
+ * body that needs the same one. */
+struct ShapeKey {
+  int type;
+  btScalar dims[4];
+
+  bool operator<(const ShapeKey& other) const {
+    if (type != other.type)
+      return type < other.type;
+    for (int i = 0; i < 4; i++) {
+      if (dims[i] != other.dims[i])
+        return dims[i] < other.dims[i];
+    }
+    return false;
+  }
+};
+
+struct CachedShape {
+  btCollisionShape *shape;
+  int refs;
+};
+
+enum BodyRole {
+  ROLE_NONE,
+  ROLE_WALL,
+  ROLE_MAIN_BALL,                     // part of the level's ball cube.
+  ROLE_BALL,                          // a shot.
+  ROLE_COUNT
+};
+
+/* Each role is its own collision filter group. */
+enum CollisionGroup {
+  COL_NONE      = 1 << ROLE_NONE,
+  COL_WALL      = 1 << ROLE_WALL,
+  COL_MAIN_BALL = 1 << ROLE_MAIN_BALL,
+  COL_BALL      = 1 << ROLE_BALL,
+  COL_ALL       = (1 << ROLE_COUNT) - 1
+};
+
+/* Every body's user pointer refers to one of these so contact callbacks can
+ * classify a pair without searching. */
+struct BodyTag {
+  int role;
+  void *owner;                        // the Ball for balls, otherwise NULL.
+};
+
+inline BodyTag* getBodyTag(const void *body) {
+  return (BodyTag *) static_cast<const btCollisionObject *>(body)->getUserPointer();
+}
+
+inline int getBodyRole(const void *body) {
+  BodyTag *tag = getBodyTag(body);
+  return tag ? tag->role : ROLE_NONE;
+}
+
+/* A body pair that passed the callback masks and started touching in the
+ * tick it was found in.  A pair that stays in contact is not reported again
+ * until it has come apart for at least one tick. */
+struct ContactEvent {
+  const btCollisionObject *body0;
+  const btCollisionObject *body1;
+  btScalar impulse;                   // largest impulse applied at any point of the pair.
+  btVector3 position;                 // world position of that point on body0.
+  unsigned long tick;
+};
+
+/* Two touching bodies, lower address first. */
+typedef std::pair<const btCollisionObject *, const btCollisionObject *> BodyPair;
+
+/* The last two tick transforms of one ball, kept in a buffer parallel to
+ * the simulator's ball list so the per-frame sync walks contiguous memory. */
+struct BodyTransform {
+  btVector3 position;
+  btVector3 previousPosition;
+  btQuaternion rotation;
+  btQuaternion previousRotation;
+  Ogre::SceneNode *node;              // NULL for balls that are not drawn.
+  bool dirty;                         // the node does not show the latest tick yet.
+  unsigned long movedTick;            // the last tick the ball moved in.
+};
+
+/* The dynamic state of one ball as captured by saveSnapshot(). */
+struct BodySnapshot {
+  btRigidBody *body;
+  btTransform transform;
+  btVector3 linearVelocity;
+  btVector3 angularVelocity;
+  btVector3 gravity;
+  btScalar invMass;                   // 0 for balls locked in place.
+  btScalar deactivationTime;
+  int activationState;
+};
+
+/* Everything needed to put a world back the way it was, held in flat
+ * arrays so taking and restoring one is a couple of copies. */
+struct WorldSnapshot {
+  std::vector<BodySnapshot> bodies;
+  std::vector<int> tiles;             // TileSimulator's remaining tile numbers, in order.
+  std::vector<BodyPair> touching;     // pairs in contact, so the same touches are reported again.
+  unsigned long tickCount;
+  double accumulator;
+};
+
 class Simulator {
 
 public:
@@ -26,23 +195,113 @@ public:
   virtual ~Simulator();
 
   virtual void initSimulator();
+  void setPhysicsConfig(const PhysicsConfig& cfg);
+  const PhysicsConfig& getPhysicsConfig();
+  bool isMultithreaded();
+  SphereWorld* getSphereWorld();
   virtual void createBounds(const int offset);
   virtual void registerCallback(void * func);
-  virtual bool simulateStep(double delay);
+  virtual bool simulateStep(double elapsed);
+  bool simulateTicks(int n);
   virtual void addPlaneBound(int x, int y, int z, int d);
-  virtual btRigidBody* addBoxShape(Ogre::SceneNode* n, int x, int y, int z);
   virtual btRigidBody* addBallShape(Ogre::SceneNode* n, int r, int m);
+  virtual btRigidBody* addBallShape(Ogre::SceneNode* n, const btVector3& pos, int r, int m);
+
+  virtual btRigidBody* reuseBallShape(btRigidBody* body, Ogre::SceneNode* n, const btVector3& pos, int r, int m);
+  virtual void parkRigidBody(btRigidBody* body);
+  virtual void removeRigidBody(btRigidBody* body);
+
+  void applyCollisionFilter(btRigidBody* body);
+  void setCollisionMask(int role, short mask);
+  void setCallbackMask(int role, short mask);
+  bool needsCallback(const void *body0, const void *body1);
+
+  btCollisionShape* acquireShape(int type, btScalar a, btScalar b = 0, btScalar c = 0, btScalar d = 0);
+  void releaseShape(btCollisionShape* shape);
+  int getNumShapes();
+
+  void setTickRate(int hz);
+  int getTickRate();
+  void setMaxTicks(int n);
+  int getMaxTicks();
+  void setDeterministic(bool on);
+  void setTimeScale(double scale);
+  double getTimeScale();
+  void setCcdRatio(double ratio);
+  double getCcdRatio();
+  int getNumCcdBodies();
+  unsigned long getTickCount();
+  int getNumSyncedNodes();
+  int getNumAwakeBodies();
+  int getNumSleepingBodies();
+  void setNodeSync(bool on);
+  const std::vector<BodyTransform>& getTransforms();
+
+  const std::vector<ContactEvent>& getContactEvents();
+
+  void setProfiler(PhysicsProfiler *prof);
+  PhysicsProfiler* getProfiler();
+  void setHashLog(StateHashLog *log);
+  StateHashLog* getHashLog();
+
+  virtual void saveSnapshot(WorldSnapshot& snap);
+  virtual bool restoreSnapshot(const WorldSnapshot& snap);
 
   virtual btDiscreteDynamicsWorld& getDynamicsWorld();
 
+protected:
+  virtual bool runTicks(int n, btScalar alpha);
+  virtual void tick();
+  void recordTransforms();
+  void syncTransforms(btScalar alpha);
+  void harvestContacts();
+  void harvestSphereContacts();
+  void addContact(const btCollisionObject *body0, const btCollisionObject *body1,
+      btScalar impulse, const btVector3& position);
+  void updateCcd();
+
+  static BodyTag wallTag;
+  PhysicsProfiler *profiler;                      // NULL unless profiling.
+  StateHashLog *hashLog;                          // NULL unless hashing each tick.
+
+protected:
+  void addFilteredBody(btRigidBody* body);
+  void applySolverConfig();
+  void trackBody(btRigidBody* body, const btTransform& start);
+
+  short collisionMasks[ROLE_COUNT];               // groups each role collides with.
+  short callbackMasks[ROLE_COUNT];                // partner groups reported as contact events.
+
 private:
+  PhysicsConfig config;
   btDefaultCollisionConfiguration* collisionConfiguration;
   btBroadphaseInterface* broadphase;
   btCollisionDispatcher* dispatcher;
   btSequentialImpulseConstraintSolver* solver;
+  btConstraintSolver* solverPool;                 // per-thread solvers of a multithreaded world.
   btDiscreteDynamicsWorld* dynamicsWorld;
+  SphereWorld* sphereWorld;                       // steps the balls instead of dynamicsWorld if set.
+
+  std::map<ShapeKey, CachedShape> shapeCache;
+  std::vector<btRigidBody *> dynamicBodies;       // bodies with an OgreMotionState.
+  std::vector<BodyTransform> transforms;          // parallel to dynamicBodies.
+  std::vector<int> dirtyBodies;                   // indices of the dirty transforms, for the sync.
+  bool dirtyStale;                                // bodies were removed or reset since the list was built.
+  int syncedNodes;                                // nodes moved by the last sync.
+  int awakeBodies;                                // balls active in the last tick.
+  int sleepingBodies;                             // balls deactivated in the last tick.
+  bool nodeSync;                                  // false when another thread places the nodes.
+  std::vector<ContactEvent> contactEvents;        // contacts from the last simulateStep().
+  std::vector<BodyPair> touchingPairs;            // pairs in contact this tick, being gathered.
+  std::vector<BodyPair> lastTouchingPairs;        // pairs in contact last tick, sorted.
 
-  std::vector<btCollisionShape *> collisionShapes;
+  double fixedStep;                               // seconds per physics tick.
+  double accumulator;                             // unsimulated scaled time.
+  double timeScale;                               // 0 pauses, < 1 is slow motion.
+  int maxTicks;                                   // tick budget per call.
+  double ccdRatio;                                // radii per tick above which a ball sweeps; 0 disables.
+  int ccdBodies;                                  // balls sweeping during the last tick.
+  unsigned long tickCount;
 };
 
 #endif // #ifndef __Simulator_h_
@@ -0,0 +1,573 @@
+#include "SphereWorld.h"
+
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+
+static const float POSITION_SLOP = 0.5f;      // overlap left alone, in world units.
+static const float POSITION_FIX = 0.8f;       // share of the rest pushed out per tick.
+static const float BOUNCE_SPEED = 40;         // slower impacts do not bounce, so resting balls settle.
+
+SphereWorld::SphereWorld():
+count(0),
+padded(0),
+iterations(4),
+cellSize(1),
+extent(0),
+tableMask(0),
+planeExtent(0)
+{
+}
+
+SphereWorld::~SphereWorld() {
+
+}
+
+/* Adds a static plane body.  Planes are taken as translated, never rotated. */
+void SphereWorld::addPlane(btRigidBody *body) {
+  const btStaticPlaneShape *shape = static_cast<const btStaticPlaneShape *>(body->getCollisionShape());
+  const btVector3& n = shape->getPlaneNormal();
+  SpherePlane plane;
+
+  plane.body = body;
+  plane.nx = n.x();
+  plane.ny = n.y();
+  plane.nz = n.z();
+  plane.d = shape->getPlaneConstant() + n.dot(body->getWorldTransform().getOrigin());
+  plane.restitution = body->getRestitution();
+  planes.push_back(plane);
+
+  if (fabs(plane.d) > planeExtent)
+    planeExtent = fabs(plane.d);
+}
+
+void SphereWorld::setIterations(int n) {
+  iterations = n > 0 ? n : 1;
+}
+
+/* Advances 'bodies', which must all be spheres, by 'dt' seconds:
+ * gravity and damping, speculative ball contacts found on a uniform grid and
+ * solved as impulses, movement, then overlap and plane push-out.  Sleeping
+ * balls stay put until something hits them.  Times go to 'profiler' if set. */
+void SphereWorld::step(const std::vector<btRigidBody *>& bodies, float dt, PhysicsProfiler *profiler) {
+  btClock timer;
+
+  load(bodies, dt);
+  integrateVelocities(dt);
+  double integration = timer.getTimeMicroseconds();
+
+  timer.reset();
+  buildGrid();
+  findPairs();
+  double broadphase = timer.getTimeMicroseconds();
+
+  timer.reset();
+  narrowphase(dt);
+  double narrow = timer.getTimeMicroseconds();
+
+  timer.reset();
+  solve();
+  double solver = timer.getTimeMicroseconds();
+
+  timer.reset();
+  integratePositions(dt);
+  integration += timer.getTimeMicroseconds();
+
+  timer.reset();
+  correctPositions();
+  collidePlanes();
+  solver += timer.getTimeMicroseconds();
+
+  timer.reset();
+  store(bodies, dt);
+  integration += timer.getTimeMicroseconds();
+
+  if (profiler) {
+    profiler->addTime(PHASE_BROADPHASE, broadphase / 1000.0);
+    profiler->addTime(PHASE_NARROWPHASE, narrow / 1000.0);
+    profiler->addTime(PHASE_SOLVER, solver / 1000.0);
+    profiler->addTime(PHASE_INTEGRATION, integration / 1000.0);
+  }
+}
+
+/* Copies the bodies into the arrays.  Locked balls (inverse mass 0) keep
+ * their Bullet velocity but count as still here, as Bullet treats them. */
+void SphereWorld::load(const std::vector<btRigidBody *>& bodies, float dt) {
+  count = bodies.size();
+  padded = (count + 3) & ~3;
+
+  px.resize(padded); py.resize(padded); pz.resize(padded);
+  qx.resize(padded); qy.resize(padded); qz.resize(padded);
+  vx.resize(padded); vy.resize(padded); vz.resize(padded);
+  gx.resize(padded); gy.resize(padded); gz.resize(padded);
+  radius.resize(padded);
+  invMass.resize(padded);
+  damping.resize(padded);
+  restitution.resize(padded);
+  moving.resize(padded);
+  group.resize(padded);
+  mask.resize(padded);
+  woken.resize(padded);
+
+  for (int i = 0; i < padded; i++) {
+    if (i >= count) {
+      px[i] = py[i] = pz[i] = vx[i] = vy[i] = vz[i] = gx[i] = gy[i] = gz[i] = 0;
+      radius[i] = invMass[i] = moving[i] = 0;
+      damping[i] = restitution[i] = 1;
+      group[i] = mask[i] = 0;
+      woken[i] = 0;
+      continue;
+    }
+
+    btRigidBody *body = bodies[i];
+    const btVector3& p = body->getCenterOfMassPosition();
+    const btBroadphaseProxy *proxy = body->getBroadphaseHandle();
+    bool dynamic = body->getInvMass() > 0;
+
+    px[i] = p.x();
+    py[i] = p.y();
+    pz[i] = p.z();
+    radius[i] = static_cast<const btSphereShape *>(body->getCollisionShape())->getRadius();
+    invMass[i] = body->getInvMass();
+    moving[i] = dynamic && body->isActive() ? 1 : 0;
+    restitution[i] = body->getRestitution();
+    group[i] = proxy ? proxy->m_collisionFilterGroup : 0;
+    mask[i] = proxy ? proxy->m_collisionFilterMask : 0;
+    woken[i] = 0;
+
+    if (dynamic) {
+      const btVector3& v = body->getLinearVelocity();
+      const btVector3& g = body->getGravity();
+
+      vx[i] = v.x();
+      vy[i] = v.y();
+      vz[i] = v.z();
+      gx[i] = g.x() * dt;
+      gy[i] = g.y() * dt;
+      gz[i] = g.z() * dt;
+      damping[i] = pow(1 - body->getLinearDamping(), dt);
+    } else {
+      vx[i] = vy[i] = vz[i] = gx[i] = gy[i] = gz[i] = 0;
+      damping[i] = 1;
+    }
+  }
+}
+
+/* v = (v + g dt) * damping and the predicted position q = p + v dt, for the
+ * moving balls. */
+void SphereWorld::integrateVelocities(float dt) {
+#ifdef __SSE__
+  __m128 step = _mm_set1_ps(dt);
+
+  for (int i = 0; i < padded; i += 4) {
+    __m128 m = _mm_loadu_ps(&moving[i]);
+    __m128 damp = _mm_loadu_ps(&damping[i]);
+    __m128 ms = _mm_mul_ps(m, step);
+
+    __m128 x = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vx[i]), _mm_mul_ps(_mm_loadu_ps(&gx[i]), m)), damp);
+    __m128 y = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vy[i]), _mm_mul_ps(_mm_loadu_ps(&gy[i]), m)), damp);
+    __m128 z = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vz[i]), _mm_mul_ps(_mm_loadu_ps(&gz[i]), m)), damp);
+
+    _mm_storeu_ps(&vx[i], x);
+    _mm_storeu_ps(&vy[i], y);
+    _mm_storeu_ps(&vz[i], z);
+    _mm_storeu_ps(&qx[i], _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_mul_ps(x, ms)));
+    _mm_storeu_ps(&qy[i], _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_mul_ps(y, ms)));
+    _mm_storeu_ps(&qz[i], _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_mul_ps(z, ms)));
+  }
+#else
+  for (int i = 0; i < padded; i++) {
+    vx[i] = (vx[i] + gx[i] * moving[i]) * damping[i];
+    vy[i] = (vy[i] + gy[i] * moving[i]) * damping[i];
+    vz[i] = (vz[i] + gz[i] * moving[i]) * damping[i];
+    qx[i] = px[i] + vx[i] * moving[i] * dt;
+    qy[i] = py[i] + vy[i] * moving[i] * dt;
+    qz[i] = pz[i] + vz[i] * moving[i] * dt;
+  }
+#endif
+}
+
+/* The cell a coordinate falls in.  The coordinate is held to the world's
+ * extent first, so a ball that has escaped the planes or gone NaN still
+ * lands in a cell whose index fits an int. */
+int SphereWorld::cellOf(float p) {
+  if (!(p > -extent))
+    p = -extent;
+  else if (p > extent)
+    p = extent;
+
+  return (int) floor(p / cellSize);
+}
+
+/* Unsigned throughout, so the products may wrap. */
+int SphereWorld::hashCell(int x, int y, int z) {
+  unsigned int h = ((unsigned int) x * 73856093u) ^ ((unsigned int) y * 19349663u)
+      ^ ((unsigned int) z * 83492791u);
+
+  return (int) (h & (unsigned int) tableMask);
+}
+
+/* Buckets the balls by the cell of their predicted position.  Cells are as
+ * wide as the largest ball, so touching balls share or neighbour a cell. */
+void SphereWorld::buildGrid() {
+  float largest = 0;
+  for (int i = 0; i < count; i++)
+    largest = radius[i] > largest ? radius[i] : largest;
+  cellSize = largest > 0 ? 2 * largest : 1;
+  extent = (planeExtent > 0 ? planeExtent : SPHERE_MAX_EXTENT) + cellSize;
+
+  int tableSize = 16;
+  while (tableSize < 2 * count)
+    tableSize <<= 1;
+  tableMask = tableSize - 1;
+
+  cellX.resize(count);
+  cellY.resize(count);
+  cellZ.resize(count);
+  bucket.resize(count);
+  sorted.resize(count);
+  bucketStart.assign(tableSize + 1, 0);
+
+  for (int i = 0; i < count; i++) {
+    cellX[i] = cellOf(qx[i]);
+    cellY[i] = cellOf(qy[i]);
+    cellZ[i] = cellOf(qz[i]);
+    bucket[i] = hashCell(cellX[i], cellY[i], cellZ[i]);
+    bucketStart[bucket[i] + 1]++;
+  }
+
+  for (int b = 0; b < tableSize; b++)
+    bucketStart[b + 1] += bucketStart[b];
+
+  bucketFill.assign(bucketStart.begin(), bucketStart.end() - 1);
+  for (int i = 0; i < count; i++)
+    sorted[bucketFill[bucket[i]]++] = i;
+}
+
+/* Every pair in neighbouring cells that may collide: at least one of the two
+ * moving, and each in the other's collision mask.  A bucket can hold other
+ * cells that hash alike, so each candidate's own cell is checked too; that
+ * also keeps a pair from being found twice. */
+void SphereWorld::findPairs() {
+  candA.clear();
+  candB.clear();
+
+  for (int i = 0; i < count; i++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+          int x = cellX[i] + dx, y = cellY[i] + dy, z = cellZ[i] + dz;
+          int b = hashCell(x, y, z);
+
+          for (int k = bucketStart[b]; k < bucketStart[b + 1]; k++) {
+            int j = sorted[k];
+
+            if (j <= i || cellX[j] != x || cellY[j] != y || cellZ[j] != z)
+              continue;
+            if (!moving[i] && !moving[j])
+              continue;
+            if (!(group[i] & mask[j]) || !(group[j] & mask[i]))
+              continue;
+
+            candA.push_back(i);
+            candB.push_back(j);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* Keeps the candidates whose predicted positions overlap, testing four
+ * pairs at a time. */
+void SphereWorld::narrowphase(float dt) {
+  int n = candA.size();
+  int k = 0;
+
+  pairs.clear();
+
+#ifdef __SSE__
+  for (; k + 4 <= n; k += 4) {
+    const int *a = &candA[k];
+    const int *b = &candB[k];
+
+    __m128 dx = _mm_sub_ps(_mm_set_ps(qx[b[3]], qx[b[2]], qx[b[1]], qx[b[0]]),
+        _mm_set_ps(qx[a[3]], qx[a[2]], qx[a[1]], qx[a[0]]));
+    __m128 dy = _mm_sub_ps(_mm_set_ps(qy[b[3]], qy[b[2]], qy[b[1]], qy[b[0]]),
+        _mm_set_ps(qy[a[3]], qy[a[2]], qy[a[1]], qy[a[0]]));
+    __m128 dz = _mm_sub_ps(_mm_set_ps(qz[b[3]], qz[b[2]], qz[b[1]], qz[b[0]]),
+        _mm_set_ps(qz[a[3]], qz[a[2]], qz[a[1]], qz[a[0]]));
+    __m128 r = _mm_add_ps(_mm_set_ps(radius[a[3]], radius[a[2]], radius[a[1]], radius[a[0]]),
+        _mm_set_ps(radius[b[3]], radius[b[2]], radius[b[1]], radius[b[0]]));
+
+    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    int hits = _mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(r, r)));
+
+    for (int lane = 0; hits; lane++, hits >>= 1) {
+      if (hits & 1)
+        addPair(a[lane], b[lane], dt);
+    }
+  }
+#endif
+
+  for (; k < n; k++) {
+    int a = candA[k], b = candB[k];
+    float dx = qx[b] - qx[a], dy = qy[b] - qy[a], dz = qz[b] - qz[a];
+    float r = radius[a] + radius[b];
+
+    if (dx * dx + dy * dy + dz * dz < r * r)
+      addPair(a, b, dt);
+  }
+}
+
+/* Sets a pair up as a speculative contact.  Apart now, the solver only stops
+ * the balls closing faster than the gap allows; touching, they bounce. */
+void SphereWorld::addPair(int a, int b, float dt) {
+  BallPair pair;
+  float dx = px[b] - px[a], dy = py[b] - py[a], dz = pz[b] - pz[a];
+  float dist = sqrt(dx * dx + dy * dy + dz * dz);
+
+  pair.a = a;
+  pair.b = b;
+  pair.impulse = 0;
+
+  if (dist > 1e-4f) {
+    pair.nx = dx / dist;
+    pair.ny = dy / dist;
+    pair.nz = dz / dist;
+  } else {
+    pair.nx = pair.nz = 0;
+    pair.ny = 1;
+  }
+
+  float gap = dist - radius[a] - radius[b];
+  float closing = (vx[b] - vx[a]) * pair.nx + (vy[b] - vy[a]) * pair.ny + (vz[b] - vz[a]) * pair.nz;
+
+  if (gap > 0)
+    pair.target = -gap / dt;
+  else
+    pair.target = closing < -BOUNCE_SPEED ? -closing * restitution[a] * restitution[b] : 0;
+
+  pairs.push_back(pair);
+}
+
+/* Sequential impulses along each pair's normal, accumulated and kept
+ * pushing.  A sleeping ball that takes an impulse wakes up. */
+void SphereWorld::solve() {
+  for (int it = 0; it < iterations; it++) {
+    std::vector<BallPair>::iterator p;
+
+    for (p = pairs.begin(); p != pairs.end(); p++) {
+      int a = p->a, b = p->b;
+      float ma = invMass[a], mb = invMass[b];
+
+      if (ma + mb <= 0)
+        continue;
+
+      float rel = (vx[b] - vx[a]) * p->nx + (vy[b] - vy[a]) * p->ny + (vz[b] - vz[a]) * p->nz;
+      float lambda = (p->target - rel) / (ma + mb);
+      float total = p->impulse + lambda > 0 ? p->impulse + lambda : 0;
+
+      lambda = total - p->impulse;
+      p->impulse = total;
+      if (lambda == 0)
+        continue;
+
+      vx[a] -= lambda * p->nx * ma;
+      vy[a] -= lambda * p->ny * ma;
+      vz[a] -= lambda * p->nz * ma;
+      vx[b] += lambda * p->nx * mb;
+      vy[b] += lambda * p->ny * mb;
+      vz[b] += lambda * p->nz * mb;
+
+      if (ma > 0 && !moving[a])
+        moving[a] = woken[a] = 1;
+      if (mb > 0 && !moving[b])
+        moving[b] = woken[b] = 1;
+    }
+  }
+}
+
+void SphereWorld::integratePositions(float dt) {
+#ifdef __SSE__
+  __m128 step = _mm_set1_ps(dt);
+
+  for (int i = 0; i < padded; i += 4) {
+    __m128 ms = _mm_mul_ps(_mm_loadu_ps(&moving[i]), step);
+
+    _mm_storeu_ps(&px[i], _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_mul_ps(_mm_loadu_ps(&vx[i]), ms)));
+    _mm_storeu_ps(&py[i], _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_mul_ps(_mm_loadu_ps(&vy[i]), ms)));
+    _mm_storeu_ps(&pz[i], _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_mul_ps(_mm_loadu_ps(&vz[i]), ms)));
+  }
+#else
+  for (int i = 0; i < padded; i++) {
+    px[i] += vx[i] * moving[i] * dt;
+    py[i] += vy[i] * moving[i] * dt;
+    pz[i] += vz[i] * moving[i] * dt;
+  }
+#endif
+}
+
+/* Pushes overlapping balls apart by their inverse masses, leaving a little
+ * overlap so resting stacks keep touching, and records a contact for every
+ * pair that took an impulse or still touches. */
+void SphereWorld::correctPositions() {
+  std::vector<BallPair>::iterator p;
+
+  contacts.clear();
+
+  for (p = pairs.begin(); p != pairs.end(); p++) {
+    int a = p->a, b = p->b;
+    float ma = invMass[a], mb = invMass[b];
+    float dx = px[b] - px[a], dy = py[b] - py[a], dz = pz[b] - pz[a];
+    float depth = radius[a] + radius[b] - sqrt(dx * dx + dy * dy + dz * dz);
+
+    if (depth > POSITION_SLOP && ma + mb > 0) {
+      float push = (depth - POSITION_SLOP) * POSITION_FIX / (ma + mb);
+
+      px[a] -= p->nx * push * ma;
+      py[a] -= p->ny * push * ma;
+      pz[a] -= p->nz * push * ma;
+      px[b] += p->nx * push * mb;
+      py[b] += p->ny * push * mb;
+      pz[b] += p->nz * push * mb;
+    }
+
+    if (p->impulse > 0 || depth >= 0) {
+      SphereContact c;
+      c.ball0 = a;
+      c.ball1 = b;
+      c.plane = -1;
+      c.impulse = p->impulse;
+      c.position = btVector3(px[a] + p->nx * radius[a], py[a] + p->ny * radius[a], pz[a] + p->nz * radius[a]);
+      contacts.push_back(c);
+    }
+  }
+}
+
+/* Planes are half-spaces, so even the fastest ball cannot pass one: each
+ * moving ball behind a plane is put back in front and its velocity into
+ * the plane reflected.  Four balls are tested against a plane at a time. */
+void SphereWorld::collidePlanes() {
+  for (size_t k = 0; k < planes.size(); k++) {
+    const SpherePlane& plane = planes[k];
+    const btBroadphaseProxy *proxy = plane.body->getBroadphaseHandle();
+    short planeGroup = proxy ? proxy->m_collisionFilterGroup : 0;
+    short planeMask = proxy ? proxy->m_collisionFilterMask : 0;
+
+    for (int i = 0; i < padded; i += 4) {
+      int hits = 0;
+
+#ifdef __SSE__
+      __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&px[i]), _mm_set1_ps(plane.nx)),
+          _mm_mul_ps(_mm_loadu_ps(&py[i]), _mm_set1_ps(plane.ny))),
+          _mm_mul_ps(_mm_loadu_ps(&pz[i]), _mm_set1_ps(plane.nz)));
+      __m128 limit = _mm_add_ps(_mm_set1_ps(plane.d), _mm_loadu_ps(&radius[i]));
+
+      hits = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(dist, limit),
+          _mm_cmpgt_ps(_mm_loadu_ps(&moving[i]), _mm_setzero_ps())));
+#else
+      for (int lane = 0; lane < 4; lane++) {
+        int j = i + lane;
+        if (moving[j] > 0 && px[j] * plane.nx + py[j] * plane.ny + pz[j] * plane.nz < plane.d + radius[j])
+          hits |= 1 << lane;
+      }
+#endif
+
+      for (int lane = 0; hits; lane++, hits >>= 1) {
+        int j = i + lane;
+
+        if (!(hits & 1) || j >= count)
+          continue;
+        if (!(group[j] & planeMask) || !(planeGroup & mask[j]))
+          continue;
+
+        float depth = plane.d + radius[j] - (px[j] * plane.nx + py[j] * plane.ny + pz[j] * plane.nz);
+        px[j] += plane.nx * depth;
+        py[j] += plane.ny * depth;
+        pz[j] += plane.nz * depth;
+
+        float vn = vx[j] * plane.nx + vy[j] * plane.ny + vz[j] * plane.nz;
+        float impulse = 0;
+
+        if (vn < 0) {
+          float bounce = vn < -BOUNCE_SPEED ? restitution[j] * plane.restitution : 0;
+          float dv = -(1 + bounce) * vn;
+
+          vx[j] += plane.nx * dv;
+          vy[j] += plane.ny * dv;
+          vz[j] += plane.nz * dv;
+          impulse = dv / invMass[j];
+        }
+
+        SphereContact c;
+        c.ball0 = j;
+        c.ball1 = -1;
+        c.plane = k;
+        c.impulse = impulse;
+        c.position = btVector3(px[j] - plane.nx * radius[j], py[j] - plane.ny * radius[j], pz[j] - plane.nz * radius[j]);
+        contacts.push_back(c);
+      }
+    }
+  }
+}
+
+/* Copies the moving balls back into their bodies and motion states, spins
+ * them by their damped angular velocity, and lets Bullet's own deactivation
+ * timer put still ones to sleep. */
+void SphereWorld::store(const std::vector<btRigidBody *>& bodies, float dt) {
+  for (int i = 0; i < count; i++) {
+    if (!moving[i])
+      continue;
+
+    btRigidBody *body = bodies[i];
+    btTransform xf = body->getCenterOfMassTransform();
+    btVector3 w = body->getAngularVelocity() * (btScalar) pow(1 - body->getAngularDamping(), dt);
+    btVector3 v(vx[i], vy[i], vz[i]);
+
+    xf.setOrigin(btVector3(px[i], py[i], pz[i]));
+
+    if (w.length2() > 0) {
+      btQuaternion q = xf.getRotation();
+      btScalar h = dt * 0.5f;
+      btScalar x = q.x() + h * (w.x() * q.w() + w.y() * q.z() - w.z() * q.y());
+      btScalar y = q.y() + h * (w.y() * q.w() + w.z() * q.x() - w.x() * q.z());
+      btScalar z = q.z() + h * (w.z() * q.w() + w.x() * q.y() - w.y() * q.x());
+      btScalar s = q.w() - h * (w.x() * q.x() + w.y() * q.y() + w.z() * q.z());
+      btScalar len = btSqrt(x * x + y * y + z * z + s * s);
+
+      xf.setRotation(btQuaternion(x / len, y / len, z / len, s / len));
+    }
+
+    if (woken[i])
+      body->activate(true);
+
+    body->setCenterOfMassTransform(xf);
+    body->setLinearVelocity(v);
+    body->setAngularVelocity(w);
+    body->getMotionState()->setWorldTransform(xf);
+
+    body->updateDeactivation(dt);
+    if (body->wantsSleeping()) {
+      body->setActivationState(ISLAND_SLEEPING);
+      body->setLinearVelocity(btVector3(0, 0, 0));
+      body->setAngularVelocity(btVector3(0, 0, 0));
+    }
+  }
+}
+
+const std::vector<SphereContact>& SphereWorld::getContacts() {
+  return contacts;
+}
+
+const SpherePlane& SphereWorld::getPlane(int i) {
+  return planes[i];
+}
+
+/* Candidate pairs the grid produced in the last step. */
+int SphereWorld::getNumPairs() {
+  return candA.size();
+}
@@ -0,0 +1,115 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    SphereWorld.h
+-----------------------------------------------------------------------------
+
+A small rigid body engine for spheres inside static planes, which is all
+this game simulates.  With PhysicsConfig::engine set to ENGINE_SPHERES,
+Simulator steps its balls through one of these instead of
+btDiscreteDynamicsWorld::stepSimulation().  Each tick copies the balls out
+of their btRigidBodies into one array per field, steps them there (four at
+a time with SSE where the compiler has it) and copies them back.  Snapshots,
+hashes, contact events and the rest of the game keep working on the Bullet
+bodies.  Contacts have no friction, so balls keep whatever spin they have.
+-----------------------------------------------------------------------------
+ */
+#ifndef __SphereWorld_h_
+#define __SphereWorld_h_
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <vector>
+
+#include "PhysicsProfiler.h"
+
+const static float SPHERE_MAX_EXTENT = 1000000;   // position bound when there are no planes.
+
+/* A touching pair from the last step, by index into the bodies passed to
+ * step() and into the planes. */
+struct SphereContact {
+  int ball0;
+  int ball1;                          // -1 for a plane.
+  int plane;                          // -1 for two balls.
+  float impulse;
+  btVector3 position;                 // on ball0's surface.
+};
+
+/* A static plane body, with its translation folded into 'd'. */
+struct SpherePlane {
+  btRigidBody *body;
+  float nx, ny, nz;
+  float d;                            // balls stay where n.p >= d + radius.
+  float restitution;
+};
+
+/* A ball pair found overlapping at the predicted positions. */
+struct BallPair {
+  int a, b;
+  float nx, ny, nz;                   // from a towards b.
+  float target;                       // normal velocity the solver aims for.
+  float impulse;                      // accumulated over the iterations.
+};
+
+class SphereWorld {
+public:
+  SphereWorld();
+  virtual ~SphereWorld();
+
+  void addPlane(btRigidBody *body);
+  void setIterations(int n);
+  void step(const std::vector<btRigidBody *>& bodies, float dt, PhysicsProfiler *profiler);
+
+  const std::vector<SphereContact>& getContacts();
+  const SpherePlane& getPlane(int i);
+  int getNumPairs();
+
+private:
+  void load(const std::vector<btRigidBody *>& bodies, float dt);
+  void integrateVelocities(float dt);
+  void buildGrid();
+  void findPairs();
+  void narrowphase(float dt);
+  void addPair(int a, int b, float dt);
+  void solve();
+  void integratePositions(float dt);
+  void correctPositions();
+  void collidePlanes();
+  void store(const std::vector<btRigidBody *>& bodies, float dt);
+  int cellOf(float p);
+  int hashCell(int x, int y, int z);
+
+  int count;                          // balls this step.
+  int padded;                         // count rounded up to a multiple of four.
+  int iterations;
+
+  // One entry per ball, padded with balls that never move or touch.
+  std::vector<float> px, py, pz;      // position.
+  std::vector<float> qx, qy, qz;      // position predicted for the end of the tick.
+  std::vector<float> vx, vy, vz;
+  std::vector<float> gx, gy, gz;      // gravity times the tick length.
+  std::vector<float> radius;
+  std::vector<float> invMass;         // 0 for balls locked in place.
+  std::vector<float> damping;         // linear velocity kept per tick.
+  std::vector<float> restitution;
+  std::vector<float> moving;          // 1 for awake dynamic balls, else 0.
+  std::vector<short> group, mask;
+  std::vector<char> woken;            // asleep at load, hit during the step.
+
+  // Uniform grid of cells two of the largest radii across, hashed into a
+  // table and bucketed by a counting sort.
+  float cellSize;
+  float extent;                       // positions are held to +-extent on each axis.
+  int tableMask;
+  std::vector<int> cellX, cellY, cellZ;
+  std::vector<int> bucket;
+  std::vector<int> bucketStart;
+  std::vector<int> bucketFill;
+  std::vector<int> sorted;
+
+  std::vector<int> candA, candB;      // pairs sharing neighbouring cells.
+  std::vector<BallPair> pairs;
+  std::vector<SpherePlane> planes;
+  float planeExtent;                  // farthest plane from the origin.
+  std::vector<SphereContact> contacts;
+};
+
+#endif // #ifndef __SphereWorld_h_
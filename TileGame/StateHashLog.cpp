@@ -0,0 +1,193 @@
+#include "StateHashLog.h"
+
+#include <fstream>
+#include <sstream>
+
+
+static const StateHash FNV_OFFSET = 14695981039346656037ULL;
+static const StateHash FNV_PRIME = 1099511628211ULL;
+
+static void fnv(StateHash& h, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *) data;
+
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= FNV_PRIME;
+  }
+}
+
+static void fnvVector(StateHash& h, const btVector3& v) {
+  btScalar xyz[3] = { v.x(), v.y(), v.z() };
+  fnv(h, xyz, sizeof(xyz));
+}
+
+StateHashLog::StateHashLog(int capacity):
+ring(capacity > 0 ? capacity : 1),
+head(0),
+count(0)
+{
+}
+
+StateHashLog::~StateHashLog() {
+
+}
+
+/* Hashes the state a peer must agree on: position, orientation and both
+ * velocities, bit for bit. */
+StateHash StateHashLog::hashBody(const btRigidBody *body) {
+  StateHash h = FNV_OFFSET;
+  const btTransform& xf = body->getCenterOfMassTransform();
+  btQuaternion rot = xf.getRotation();
+  btScalar q[4] = { rot.x(), rot.y(), rot.z(), rot.w() };
+
+  fnvVector(h, xf.getOrigin());
+  fnv(h, q, sizeof(q));
+  fnvVector(h, body->getLinearVelocity());
+  fnvVector(h, body->getAngularVelocity());
+
+  return h;
+}
+
+/* Overwrites the oldest entry.  Its per-ball vector keeps its storage, so a
+ * full ring records without allocating. */
+void StateHashLog::record(unsigned long tick, const std::vector<btRigidBody *>& balls) {
+  TickHash& entry = ring[head];
+  StateHash world = FNV_OFFSET;
+
+  entry.tick = tick;
+  entry.bodies.resize(balls.size());
+
+  for (size_t i = 0; i < balls.size(); i++) {
+    entry.bodies[i] = hashBody(balls[i]);
+    fnv(world, &entry.bodies[i], sizeof(StateHash));
+  }
+  entry.world = world;
+
+  head = (head + 1) % ring.size();
+  if (count < (int) ring.size())
+    count++;
+}
+
+void StateHashLog::clear() {
+  head = count = 0;
+}
+
+/* Forgets the ticks after 'tick', for a world put back to that tick, so a
+ * replay records each tick once more instead of a second time. */
+void StateHashLog::rewind(unsigned long tick) {
+  while (count > 0 && at(count - 1).tick > tick) {
+    head = (head + ring.size() - 1) % ring.size();
+    count--;
+  }
+}
+
+/* Oldest first. */
+const TickHash& StateHashLog::at(int i) const {
+  return ring[(head + ring.size() - count + i) % ring.size()];
+}
+
+const TickHash* StateHashLog::find(unsigned long tick) const {
+  for (int i = count - 1; i >= 0; i--) {
+    if (at(i).tick == tick)
+      return &at(i);
+  }
+
+  return NULL;
+}
+
+const TickHash* StateHashLog::getLast() const {
+  return count ? &at(count - 1) : NULL;
+}
+
+int StateHashLog::getNumTicks() const {
+  return count;
+}
+
+/* For hashes a peer sends: false only if we hold 'tick' and disagree. */
+bool StateHashLog::check(unsigned long tick, StateHash world) {
+  const TickHash *mine = find(tick);
+  return !mine || mine->world == world;
+}
+
+DesyncReport StateHashLog::compare(const StateHashLog& other) const {
+  DesyncReport report;
+  report.diverged = false;
+  report.tick = 0;
+
+  for (int i = 0; i < count; i++) {
+    const TickHash& mine = at(i);
+    const TickHash *theirs = other.find(mine.tick);
+
+    if (!theirs || theirs->world == mine.world)
+      continue;
+
+    report.diverged = true;
+    report.tick = mine.tick;
+
+    // Only differing counts or per-ball hashes that were recorded can name
+    // balls; a trace without them just reports the tick.
+    size_t n = mine.bodies.size() > theirs->bodies.size() ? mine.bodies.size() : theirs->bodies.size();
+    for (size_t b = 0; b < n; b++) {
+      if (b >= mine.bodies.size() || b >= theirs->bodies.size()
+          || mine.bodies[b] != theirs->bodies[b])
+        report.bodies.push_back(b);
+    }
+    break;
+  }
+
+  return report;
+}
+
+/* One line per tick: the tick, the world hash and every ball's hash. */
+bool StateHashLog::writeTrace(const std::string& path) const {
+  std::ofstream out(path.c_str());
+  if (!out)
+    return false;
+
+  out << std::hex;
+  for (int i = 0; i < count; i++) {
+    const TickHash& entry = at(i);
+
+    out << entry.tick << " " << entry.world;
+    for (size_t b = 0; b < entry.bodies.size(); b++)
+      out << " " << entry.bodies[b];
+    out << std::endl;
+  }
+
+  return true;
+}
+
+/* Replaces the log with a trace written by writeTrace(), growing the ring
+ * if the trace is longer. */
+bool StateHashLog::readTrace(const std::string& path) {
+  std::ifstream in(path.c_str());
+  std::string line;
+  std::vector<TickHash> entries;
+
+  if (!in)
+    return false;
+
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    TickHash entry;
+    StateHash h;
+
+    ss >> std::hex;
+    if (!(ss >> entry.tick >> entry.world))
+      continue;
+    while (ss >> h)
+      entry.bodies.push_back(h);
+    entries.push_back(entry);
+  }
+
+  if (entries.size() > ring.size())
+    ring.resize(entries.size());
+  clear();
+  for (size_t i = 0; i < entries.size(); i++) {
+    ring[head] = entries[i];
+    head = (head + 1) % ring.size();
+    count++;
+  }
+
+  return true;
+}
@@ -0,0 +1,63 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    StateHashLog.h
+-----------------------------------------------------------------------------
+
+Fingerprints of the simulated world, one per physics tick.  Every ball's
+transform and velocities are hashed (FNV-1a over the raw floats) after each
+tick; the world hash combines them in the simulator's ball order.  The last
+'capacity' ticks are kept, each with its per-ball hashes, so two logs can be
+compared for the first tick they disagree on and the balls responsible.
+-----------------------------------------------------------------------------
+ */
+#ifndef __StateHashLog_h_
+#define __StateHashLog_h_
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <string>
+#include <vector>
+
+
+typedef unsigned long long StateHash;
+
+struct TickHash {
+  unsigned long tick;
+  StateHash world;
+  std::vector<StateHash> bodies;
+};
+
+struct DesyncReport {
+  bool diverged;
+  unsigned long tick;                 // first tick both logs hold that differs.
+  std::vector<int> bodies;            // ball indices whose hashes differ there.
+};
+
+class StateHashLog {
+public:
+  StateHashLog(int capacity = 600);
+  virtual ~StateHashLog();
+
+  void record(unsigned long tick, const std::vector<btRigidBody *>& balls);
+  void clear();
+  void rewind(unsigned long tick);
+
+  bool check(unsigned long tick, StateHash world);
+  DesyncReport compare(const StateHashLog& other) const;
+  const TickHash* find(unsigned long tick) const;
+  const TickHash* getLast() const;
+  int getNumTicks() const;
+
+  bool writeTrace(const std::string& path) const;
+  bool readTrace(const std::string& path);
+
+  static StateHash hashBody(const btRigidBody *body);
+
+private:
+  const TickHash& at(int i) const;
+
+  std::vector<TickHash> ring;
+  int head;                           // next slot to write.
+  int count;
+};
+
+#endif // #ifndef __StateHashLog_h_
@@ -26,11 +26,15 @@ TileGame::TileGame(void) :
 mDirection(Ogre::Vector3::ZERO),
 headNode(0),
 ballMgr(0),
+levelMgr(0),
+profiler(0),
+physicsThread(0),
 soundMgr(0),
 netMgr(0),
 sim(0),
 panelLight(0),
 scorePanel(0),
+physicsPanel(0),
 congratsPanel(0),
 chargePanel(0),
 clientAcceptDescPanel(0),
@@ -57,7 +61,7 @@ noteIndex(0)
   gameStart = true;
 
   mSpeed = score = shotsFired = tileCounter = winTimer = chargeShot =
-      slowdownval = currTile = nPlayers = ballsounddelay = 0;
+      currTile = nPlayers = ballsounddelay = 0;
   currLevel = 1;
 
   mTimer = OGRE_NEW Ogre::Timer();
@@ -68,6 +72,9 @@ noteIndex(0)
 }
 //-------------------------------------------------------------------------------------
 TileGame::~TileGame(void) {
+  togglePhysicsThread(false);
+  togglePhysicsProfiler(false);
+  delete levelMgr;
   delete soundMgr;
   delete ballMgr;
   delete netMgr;
@@ -85,7 +92,13 @@ bool TileGame::configure() {
   }
 
   // Physics //
+  // Solo play drops frame time it cannot catch up on; startMultiplayer()
+  // makes the world deterministic once there are peers.
+  PhysicsConfig physicsConfig;
+
   sim = new TileSimulator();
+  sim->setPhysicsConfig(physicsConfig);
+  sim->setArena(arena);
   sim->initSimulator();
 
   // Balls //
@@ -130,62 +143,62 @@ void TileGame::createScene(void) {
   // Use the planes from above to generate new meshes for walls.
   Ogre::MeshManager::getSingleton().createPlane("ground",
       Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, wallDown,
-      WALL_SIZE, WALL_SIZE, 20, 20, true, 1, 1, 1, Ogre::Vector3::UNIT_Z);
+      arena.wallSize, arena.wallSize, 20, 20, true, 1, 1, 1, Ogre::Vector3::UNIT_Z);
   Ogre::Entity* entGround = mSceneMgr->createEntity("GroundEntity", "ground");
   entGround->setMaterialName("Custom/texture_blend");
   entGround->setCastShadows(false);
   Ogre::SceneNode* nodeGround = mSceneMgr->getRootSceneNode()->createChildSceneNode();
-  nodeGround->setPosition(0 , -PLANE_DIST, 0);
+  nodeGround->setPosition(0 , -arena.getPlaneDist(), 0);
   nodeGround->attachObject(entGround);
 
   Ogre::MeshManager::getSingleton().createPlane("ceiling",
       Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, wallUp,
-      WALL_SIZE, WALL_SIZE, 20, 20, true, 1, 2, 2, Ogre::Vector3::UNIT_Z);
+      arena.wallSize, arena.wallSize, 20, 20, true, 1, 2, 2, Ogre::Vector3::UNIT_Z);
   Ogre::Entity* entCeiling = mSceneMgr->createEntity("CeilingEntity", "ceiling");
   entCeiling->setMaterialName("Examples/CloudySky");
   entCeiling->setCastShadows(false);
   Ogre::SceneNode* nodeCeiling = mSceneMgr->getRootSceneNode()->createChildSceneNode();
-  nodeCeiling->setPosition(0 , PLANE_DIST, 0);
+  nodeCeiling->setPosition(0 , arena.getPlaneDist(), 0);
   nodeCeiling->attachObject(entCeiling);
 
   Ogre::MeshManager::getSingleton().createPlane("back",
       Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, wallBack,
-      WALL_SIZE, WALL_SIZE, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
+      arena.wallSize, arena.wallSize, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
   Ogre::Entity* entBack = mSceneMgr->createEntity("BackEntity", "back");
   entBack->setMaterialName("Examples/Rockwall");
   entBack->setCastShadows(false);
   Ogre::SceneNode* nodeBack = mSceneMgr->getRootSceneNode()->createChildSceneNode("backNode");
-  nodeBack->setPosition(0 , 0, PLANE_DIST);
+  nodeBack->setPosition(0 , 0, arena.getPlaneDist());
   nodeBack->attachObject(entBack);
 
   Ogre::MeshManager::getSingleton().createPlane("front",
       Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, wallFront,
-      WALL_SIZE, WALL_SIZE, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
+      arena.wallSize, arena.wallSize, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
   Ogre::Entity* entFront = mSceneMgr->createEntity("FrontEntity", "front");
   entFront->setMaterialName("Examples/Rockwall");
   entFront->setCastShadows(false);
   Ogre::SceneNode* nodeFront = mSceneMgr->getRootSceneNode()->createChildSceneNode("frontNode");
-  nodeFront->setPosition(0 , 0, -PLANE_DIST);
+  nodeFront->setPosition(0 , 0, -arena.getPlaneDist());
   nodeFront->attachObject(entFront);
 
   Ogre::MeshManager::getSingleton().createPlane("left",
       Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, wallLeft,
-      WALL_SIZE, WALL_SIZE, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
+      arena.wallSize, arena.wallSize, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
   Ogre::Entity* entLeft = mSceneMgr->createEntity("LeftEntity", "left");
   entLeft->setMaterialName("Examples/Rockwall");
   entLeft->setCastShadows(false);
   Ogre::SceneNode* nodeLeft = mSceneMgr->getRootSceneNode()->createChildSceneNode("leftNode");
-  nodeLeft->setPosition(-PLANE_DIST , 0, 0);
+  nodeLeft->setPosition(-arena.getPlaneDist() , 0, 0);
   nodeLeft->attachObject(entLeft);
 
   Ogre::MeshManager::getSingleton().createPlane("right",
       Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, wallRight,
-      WALL_SIZE, WALL_SIZE, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
+      arena.wallSize, arena.wallSize, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
   Ogre::Entity* entRight = mSceneMgr->createEntity("RightEntity", "right");
   entRight->setMaterialName("Examples/Rockwall");
   entRight->setCastShadows(false);
   Ogre::SceneNode* nodeRight = mSceneMgr->getRootSceneNode()->createChildSceneNode("rightNode");
-  nodeRight->setPosition(PLANE_DIST, 0, 0);
+  nodeRight->setPosition(arena.getPlaneDist(), 0, 0);
   nodeRight->attachObject(entRight);
 
   // Set ambient light
@@ -198,8 +211,9 @@ void TileGame::createScene(void) {
   lSun->setPosition(0,1400,0);
   lSun->setAttenuation(3250, 1.0, 0.0000000001, 0.000001);
 
-  sim->createBounds(PLANE_DIST);
+  sim->createBounds(arena.getPlaneDist());
 
+  levelMgr = new LevelManager(mSceneMgr, sim, ballMgr);
   levelSetup(currLevel);
 }
 //-------------------------------------------------------------------------------------
@@ -226,6 +240,16 @@ void TileGame::createFrameListener(void) {
   playersWaitingPanel = mTrayMgr->createParamsPanel(OgreBites::TL_BOTTOMRIGHT,
       "PlayersWaitingPanel", 200, playerCountTag);
 
+  // Physics timings, toggled with H like the details panel is with G.
+  Ogre::StringVector phaselist;
+  for (int p = 0; p < PHASE_COUNT; p++)
+    phaselist.push_back(PhysicsProfiler::getPhaseName(p) + std::string(" (ms)"));
+  phaselist.push_back("awake balls");
+  phaselist.push_back("asleep balls");
+  physicsPanel = mTrayMgr->createParamsPanel(OgreBites::TL_NONE,
+      "PhysicsPanel", 220, phaselist);
+  physicsPanel->hide();
+
   mTrayMgr->getTrayContainer(OgreBites::TL_TOPRIGHT)->hide();
   mTrayMgr->getTrayContainer(OgreBites::TL_BOTTOMRIGHT)->hide();
 
@@ -252,41 +276,45 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
   //soundMgr->updateSounds(mCamera->getPosition(), direction);
   soundMgr->updateSounds(mCamera);
   // soundMgr->updateSounds(mCamera);
-  if (paused)
-    slowdownval += 1/1800.f;
-  else {
-    bool hit = sim->simulateStep(slowdownval);
-
-    if (hit && !gameDone) {
-
-
+  // Pausing sets the time scale to zero, so no ticks run while paused.
+  int hits;
+  if (physicsThread) {
+    physicsThread->syncNodes();
+    hits = physicsThread->takeHits();
+  } else {
+    sim->simulateStep(evt.timeSinceLastFrame);
+    hits = sim->getNumHits();
+  }
 
-      soundMgr->playSound(boing);
-      score++;
+  // Several tiles can fall in one step; each hit is scored on its own.
+  for (i = hits; i > 0 && !gameDone; i--) {
+    soundMgr->playSound(boing);
+    score++;
 
-      if (!tileEntities.empty()) {
-        // Play the corresponding sound of that tile.
-        if(tileEntities.size() <= noteSequence.size()) {
-          soundMgr->playSound(noteSequence[tileEntities.size() - 1], tileEntities.back()->getParentNode()->_getDerivedPosition(), mCamera);
-        }
-        // update texture
-        tileEntities.back()->setMaterialName("Examples/BumpyMetal");
-        tileEntities.pop_back();
-        tileSceneNodes.pop_back();
+    if (!tileEntities.empty()) {
+      // Play the corresponding sound of that tile.
+      if(tileEntities.size() <= noteSequence.size()) {
+        soundMgr->playSound(noteSequence[tileEntities.size() - 1], tileEntities.back()->getParentNode()->_getDerivedPosition(), mCamera);
       }
+      // update texture
+      tileEntities.back()->setMaterialName("Examples/BumpyMetal");
+      tileEntities.pop_back();
+      tileSceneNodes.pop_back();
+    }
 
-      if (tileEntities.empty()) {
-        gameDone = true;
-        winTimer = 0;
-        congratsPanel->show();
-        ballMgr->enableGravity();
-      }
+    // The simulator has already dropped the balls.
+    if (tileEntities.empty()) {
+      gameDone = true;
+      winTimer = 0;
+      congratsPanel->show();
     }
   }
 
   if (gameDone && !paused && winTimer++ > 320) {
+    lockPhysics();
     levelTearDown();
     levelSetup(currLevel);
+    unlockPhysics();
     congratsPanel->hide();
   }
 
@@ -320,13 +348,32 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
     // Number of players in the game.
     playersWaitingPanel->setParamValue(0,
         Ogre::StringConverter::toString(nPlayers + 1));
+
+    // Physics timings, averaged over the profiler's ring.  The physics
+    // thread publishes its own average, so the frame never waits on it.
+    if (profiler && physicsPanel->isVisible()) {
+      ProfileSample avg;
+      bool ready = true;
+
+      if (physicsThread)
+        ready = physicsThread->getProfile(avg);
+      else
+        avg = profiler->getAverage();
+
+      if (ready) {
+        for (int p = 0; p < PHASE_COUNT; p++)
+          physicsPanel->setParamValue(p, Ogre::StringConverter::toString((Ogre::Real) avg.ms[p], 3));
+        physicsPanel->setParamValue(PHASE_COUNT, Ogre::StringConverter::toString(avg.awake));
+        physicsPanel->setParamValue(PHASE_COUNT + 1, Ogre::StringConverter::toString(avg.asleep));
+      }
+    }
   }
 
   if(ballsounddelay > 0)
     ballsounddelay--;
   else
   {
-    int numCollisions = ballMgr->getNumberBallCollisions();
+    int numCollisions = physicsThread ? physicsThread->takeBallCollisions() : ballMgr->getNumberBallCollisions();
     if(numCollisions > 0)
     {
       soundMgr->playSound(boing);
@@ -349,8 +396,10 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
   if (netActive && (netTimer->getMilliseconds() > SWEEP_MS)) {
     std::string cmd, cmdArgs;
     std::ostringstream test;
+    const char *msg;
     Uint32 *data;
-    int nUp;
+    int nUp, len;
+    int playerMsg = sizeof(Uint32) + sizeof(PlayerData);    // a tag and one player.
 
     /*  Received an update!  */
     if ((nUp = netMgr->scanForActivity())) {
@@ -358,46 +407,44 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
       if (!server) {  /* **************      CLIENT      ******************* */
 
         if (!connected) {                       /* Running as single player. */
-          if (!invitePending) {
-            // Accept only the first invitation received if spammed.
-            if (netMgr->udpServerData[0].updated) {
-              invite = std::string(netMgr->udpServerData[0].output);
+          // Accept only the first invitation received if spammed.
+          while ((msg = netMgr->udpServerData.output.front(&len))) {
+            if (!invitePending) {
+              invite = std::string(msg);
               if (std::string::npos != invite.find(STR_OPEN)) {
                 mTrayMgr->getTrayContainer(OgreBites::TL_TOPRIGHT)->show();
                 mTrayMgr->getTrayContainer(OgreBites::TL_BOTTOMRIGHT)->show();
                 invitePending = true;
               }
-              netMgr->udpServerData[0].updated = false;
             }
+            netMgr->udpServerData.output.pop();
           }
         } else {                           /* Connected and running in game. */
 
           // Process UDP messages.
-          for (i = 0; i < nUp; i++) {
-            if (netMgr->udpServerData[i].updated) {
-              data = (Uint32 *) netMgr->udpServerData[i].output;
-
-              if ((data[0] == UINT_ADDPL) && (data[1] != netMgr->getIPnbo())) {
-                j = 0;
-                while (j < nPlayers && (data[1] != playerData[j]->host))
-                  j++;
-                if (j == nPlayers) {
-                  addPlayer(++data);
-                  nPlayers = playerData.size();
-                }
-              } else if ((data[0] == UINT_UPDPL) && (data[1] != netMgr->getIPnbo())) {
-                for (j = 0; j < nPlayers; j++) {
-                  if (data[1] == playerData[j]->host) {
-                    modifyPlayer(j, ++data);
-                  }
+          while ((msg = netMgr->udpServerData.output.front(&len))) {
+            data = (Uint32 *) msg;
+
+            if ((len >= playerMsg) && (data[0] == UINT_ADDPL) && (data[1] != netMgr->getIPnbo())) {
+              j = 0;
+              while (j < nPlayers && (data[1] != playerData[j]->host))
+                j++;
+              if (j == nPlayers) {
+                addPlayer(++data);
+                nPlayers = playerData.size();
+              }
+            } else if ((len >= playerMsg) && (data[0] == UINT_UPDPL) && (data[1] != netMgr->getIPnbo())) {
+              for (j = 0; j < nPlayers; j++) {
+                if (data[1] == playerData[j]->host) {
+                  modifyPlayer(j, ++data);
                 }
               }
-              netMgr->udpServerData[i].updated = false;
             }
+            netMgr->udpServerData.output.pop();
           }
           // Process TCP messages.
-          if (netMgr->tcpServerData.updated) {
-            cmd = std::string(netMgr->tcpServerData.output);
+          while ((msg = netMgr->tcpServerData.output.front(&len))) {
+            cmd = std::string(msg);
 
             if (0 == cmd.find(STR_BEGIN)) {
               mTrayMgr->destroyWidget("ServerStartPanel");
@@ -405,7 +452,7 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
               startMultiplayer();
             }
 
-            netMgr->tcpServerData.updated = false;
+            netMgr->tcpServerData.output.pop();
           }
         }
       } else {  /* ****************      SERVER      *********************** */
@@ -414,16 +461,19 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
           // Update player count.
           nPlayers = netMgr->getClients();
 
-          // If new players, add to own list and notify clients.
+          // If new players, add to own list and notify clients.  Each new
+          // client's first UDP message announces it.
           if (nPlayers > playerData.size()) {
-            int newClients = nPlayers - playerData.size();
+            for (i = playerData.size(); i < nPlayers && i < netMgr->udpClientData.size(); i++) {
+              MessageRing& ring = netMgr->udpClientData[i]->output;
 
-            for (i = 1; i <= newClients; i++) {
-              data = (Uint32 *) netMgr->udpClientData[nPlayers-i]->output;
-              if (data[0] == UINT_ADDPL) {
-                addPlayer(++data);
-                notifyPlayers();
-                netMgr->udpClientData[nPlayers-i]->updated = false;
+              while ((msg = ring.front(&len))) {
+                data = (Uint32 *) msg;
+                if (len >= playerMsg && data[0] == UINT_ADDPL && playerData.size() == i) {
+                  addPlayer(++data);
+                  notifyPlayers();
+                }
+                ring.pop();
               }
             }
             serverStartPanel->setCaption("Press (B) to start when ready.");
@@ -431,34 +481,37 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
 
         } else {                      /* Hosting a running game as a server. */
 
-          for (i = 0; i < nPlayers; i++) {
-            // Process UDP messages.
-            if (netMgr->udpClientData[i]->updated) {
-              data = (Uint32 *) netMgr->udpClientData[i]->output;
-              if ((data[0] == UINT_UPDSV) && (data[1] != netMgr->getIPnbo())) {
+          // Process UDP messages.
+          for (i = 0; i < nPlayers && i < netMgr->udpClientData.size(); i++) {
+            MessageRing& ring = netMgr->udpClientData[i]->output;
+
+            while ((msg = ring.front(&len))) {
+              data = (Uint32 *) msg;
+              if ((len >= playerMsg) && (data[0] == UINT_UPDSV) && (data[1] != netMgr->getIPnbo())) {
                 for (j = 0; j < nPlayers; j++) {
                   if (data[1] == playerData[j]->host) {
                     modifyPlayer(j, ++data);
                   }
                 }
               }
-              netMgr->udpClientData[i]->updated = false;
+              ring.pop();
             }
+          }
 
-            // Process TCP messages.
-            if (netMgr->tcpClientData[i]->updated) {
-              cmd = std::string(netMgr->tcpClientData[i]->output);
-              data = (Uint32 *) netMgr->tcpClientData[i]->output;
+          // Process TCP messages.
+          for (i = 0; i < nPlayers && i < netMgr->tcpClientData.size(); i++) {
+            MessageRing& ring = netMgr->tcpClientData[i]->output;
 
-              if ((data[0] == UINT_BLSHT) && (data[1] != netMgr->getIPnbo())) {
+            while ((msg = ring.front(&len))) {
+              data = (Uint32 *) msg;
+              if ((len >= playerMsg) && (data[0] == UINT_BLSHT) && (data[1] != netMgr->getIPnbo())) {
                 for (j = 0; j < nPlayers; j++) {
                   if (data[1] == playerData[j]->host) {
                     modifyPlayer(j, ++data);
                   }
                 }
               }
-
-              netMgr->tcpClientData[i]->updated = false;
+              ring.pop();
             }
           }
         }
@@ -509,6 +562,89 @@ bool TileGame::frameRenderingQueued(const Ogre::FrameEvent& evt) {
   return ret;
 }
 //-------------------------------------------------------------------------------------
+/* Starts or stops per-phase physics timing.  Stopping writes the last
+ * PROFILE_FRAMES frames to PROFILE_CSV. */
+void TileGame::togglePhysicsProfiler(bool on) {
+  if (on && !profiler) {
+    profiler = new PhysicsProfiler(PROFILE_FRAMES);
+    lockPhysics();
+    sim->setProfiler(profiler);
+    unlockPhysics();
+    mTrayMgr->moveWidgetToTray(physicsPanel, OgreBites::TL_BOTTOMLEFT, 0);
+    physicsPanel->show();
+  } else if (!on && profiler) {
+    lockPhysics();
+    sim->setProfiler(NULL);
+    unlockPhysics();
+    if (profiler->writeCsv(PROFILE_CSV))
+      std::cout << "Physics timings written to " << PROFILE_CSV << std::endl;
+    delete profiler;
+    profiler = NULL;
+
+    if (physicsPanel) {
+      mTrayMgr->removeWidgetFromTray(physicsPanel);
+      physicsPanel->hide();
+    }
+  }
+}
+//-------------------------------------------------------------------------------------
+/* Moves the simulation onto its own thread, stepping at the tick rate
+ * whatever the frame rate, or back into frameRenderingQueued(). */
+void TileGame::togglePhysicsThread(bool on) {
+  if (on && !physicsThread) {
+    physicsThread = new PhysicsThread(sim, ballMgr);
+    if (physicsThread->start()) {
+      std::cout << "TileGame: Physics running on its own thread." << std::endl;
+    } else {
+      delete physicsThread;
+      physicsThread = NULL;
+    }
+  } else if (!on && physicsThread) {
+    physicsThread->stop();
+    delete physicsThread;
+    physicsThread = NULL;
+    std::cout << "TileGame: Physics running on the render thread." << std::endl;
+  }
+}
+//-------------------------------------------------------------------------------------
+/* The render thread may only touch the simulator or ball manager between
+ * these while the physics thread runs.  Both do nothing otherwise. */
+void TileGame::lockPhysics() {
+  if (physicsThread)
+    physicsThread->lock();
+}
+
+void TileGame::unlockPhysics() {
+  if (physicsThread)
+    physicsThread->unlock();
+}
+//-------------------------------------------------------------------------------------
+/* Launches a ball for 'player' (-1 for the local one) from 'pos' on the
+ * simulator's next tick. */
+void TileGame::fireShot(int player, const Ogre::Vector3& pos, const Ogre::Vector3& dir, double force) {
+  Ogre::SceneNode* nodepc = mSceneMgr->getRootSceneNode()->createChildSceneNode();
+  Ogre::Entity* ballMeshpc = mSceneMgr->createEntity("sphere.mesh");
+
+  ballMeshpc->setCastShadows(true);
+  nodepc->attachObject(ballMeshpc);
+  nodepc->setPosition(pos);
+
+  ShotInput shot;
+  shot.player = player;
+  shot.node = nodepc;
+  shot.position = btVector3(pos.x, pos.y, pos.z);
+  shot.direction = btVector3(dir.x, dir.y, dir.z);
+  shot.force = force;
+
+  if (!physicsThread) {
+    shot.tick = sim->getTickCount();
+    sim->queueShot(shot);
+  } else if (!physicsThread->queueShot(shot)) {
+    std::cerr << "TileGame: Shot queue full, shot dropped." << std::endl;
+    Ball::destroyNode(nodepc);
+  }
+}
+//-------------------------------------------------------------------------------------
 bool TileGame::keyPressed( const OIS::KeyEvent &arg ) {
   if (arg.key == OIS::KC_ESCAPE) {
     mShutDown = true;
@@ -540,13 +676,21 @@ bool TileGame::keyPressed( const OIS::KeyEvent &arg ) {
     }
   } else if (arg.key == OIS::KC_P) {
     paused = !paused;
-    slowdownval = 0.0;
+    lockPhysics();
+    sim->setTimeScale(paused ? 0 : 1);
+    unlockPhysics();
 
     soundMgr->toggleSound();
   }
   else if (arg.key == OIS::KC_M) {
     soundMgr->toggleSound();
   }
+  else if (arg.key == OIS::KC_H) {
+    togglePhysicsProfiler(!profiler);
+  }
+  else if (arg.key == OIS::KC_J) {
+    togglePhysicsThread(!physicsThread);
+  }
   else if (arg.key == OIS::KC_I) {
     std::cout << netMgr->getIPstring() << std::endl;
   }
@@ -608,22 +752,14 @@ bool TileGame::mouseReleased( const OIS::MouseEvent &arg, OIS::MouseButtonID id
   isCharging = false;
   if(chargeShot >= 1000 && !gameDone) {
     Ogre::Vector3 direction = mCamera->getOrientation() * Ogre::Vector3::NEGATIVE_UNIT_Z;
-    Ogre::SceneNode* nodepc = mSceneMgr->getRootSceneNode()->createChildSceneNode();
-    Ogre::Entity* ballMeshpc = mSceneMgr->createEntity("sphere.mesh");
     double force = chargeShot * 0.85f;
     chargeShot = 0;
 
-    if (ballMgr->isGlobalBall())
-      ballMgr->removeGlobalBall();
-
     int x = mCamera->getPosition().x;
     int y = mCamera->getPosition().y;
     int z = mCamera->getPosition().z;
 
-    ballMeshpc->setCastShadows(true);
-    nodepc->attachObject(ballMeshpc);
-    ballMgr->setGlobalBall(ballMgr->addBall(nodepc, x, y, z, 100));
-    ballMgr->globalBall->applyForce(force, direction);
+    fireShot(-1, Ogre::Vector3(x, y, z), direction, force);
     shotsFired++;
 
     if (multiplayerStarted && connected) {
@@ -19,19 +19,19 @@ This source file is part of the
 
 #include "BaseGame.h"
 #include "BallManager.h"
+#include "LevelManager.h"
+#include "PhysicsThread.h"
 #include "SoundManager.h"
 #include "NetManager.h"
+#include "TileLayout.h"
 
 #include <vector>
 #include <string>
 
-const static int WALL_SIZE = 2400;
-const static int PLANE_DIST = WALL_SIZE / 2;                        // the initial offset from the center.
-const static int NUM_TILES_ROW = 5;                                 // number of tiles in each row of a wall.
-const static int NUM_TILES_WALL = NUM_TILES_ROW * NUM_TILES_ROW;    // number of total tiles on a wall.
-const static int TILE_WIDTH = WALL_SIZE / NUM_TILES_ROW;
 const static int SWEEP_MS = 150;
 const static int BROAD_MS = 8000;
+const static int PROFILE_FRAMES = 600;          // frames kept by the physics profiler.
+const static char PROFILE_CSV[] = "physics_profile.csv";
 
 int ticks = 0;
 
@@ -102,6 +102,11 @@ protected:
   virtual void createFrameListener(void);
   virtual bool frameRenderingQueued(const Ogre::FrameEvent& evt);
   virtual bool keyPressed( const OIS::KeyEvent &arg );
+  void togglePhysicsProfiler(bool on);
+  void togglePhysicsThread(bool on);
+  void lockPhysics();
+  void unlockPhysics();
+  void fireShot(int player, const Ogre::Vector3& pos, const Ogre::Vector3& dir, double force);
   //virtual bool mouseMoved( const OIS::MouseEvent &arg );
   virtual bool mousePressed( const OIS::MouseEvent &arg, OIS::MouseButtonID id );
   virtual bool mouseReleased( const OIS::MouseEvent &arg, OIS::MouseButtonID id );
@@ -112,8 +117,6 @@ protected:
   Ogre::Vector3 mDirection;
   Ogre::Real mSpeed;
 
-  std::deque<Ogre::Entity *> allTileEntities;
-  std::deque<Ogre::SceneNode *> tileList;
   std::deque<Ogre::Entity *> tileEntities;
   std::deque<Ogre::SceneNode *> tileSceneNodes;
   std::vector<Ogre::Entity *> playerEntities;
@@ -121,13 +124,17 @@ protected:
   std::vector<PlayerData *> playerData;
   std::vector<PlayerOldData *> playerOldData;
 
-  OgreBites::ParamsPanel *scorePanel, *playersWaitingPanel;
+  OgreBites::ParamsPanel *scorePanel, *playersWaitingPanel, *physicsPanel;
   OgreBites::Label *congratsPanel, *chargePanel, *clientAcceptDescPanel,
   *clientAcceptOptPanel, *serverStartPanel;
   Ogre::Overlay* crosshairOverlay;
 
   TileSimulator *sim;
   BallManager *ballMgr;
+  LevelManager *levelMgr;
+  PhysicsProfiler *profiler;
+  PhysicsThread *physicsThread;                 // NULL while physics runs in frameRenderingQueued.
+  ArenaLayout arena;                            // the default arena; peers must agree on it.
   SoundManager *soundMgr;
   NetManager *netMgr;
 
@@ -139,137 +146,68 @@ protected:
   netActive, invitePending, inviteAccepted, multiplayerStarted;
   int score, shotsFired, currLevel, currTile, winTimer, tileCounter, chargeShot,
   nPlayers;
-  double slowdownval;
   std::string invite;
   int ballsounddelay;
 
 
   void shootBall(int idx, int x, int y, int z, double force) {
-    Ogre::Vector3 direction = playerData[idx]->shotDir;
-    Ogre::SceneNode* nodepc = mSceneMgr->getRootSceneNode()->createChildSceneNode();
-    Ogre::Entity* ballMeshpc = mSceneMgr->createEntity("sphere.mesh");
-
-    if (ballMgr->isPlayerBall(idx))
-      ballMgr->removePlayerBall(idx);
-
-    ballMeshpc->setCastShadows(true);
-    nodepc->attachObject(ballMeshpc);
-    ballMgr->setPlayerBall(ballMgr->addBall(nodepc, x, y, z, 100), idx);
-    ballMgr->playerBalls[idx]->applyForce(force, direction);
+    fireShot(idx, Ogre::Vector3(x, y, z), playerData[idx]->shotDir, force);
   }
 
-  void ballSetup (int cubeSize) {
-    float ballSize = 200;                   //diameter
-    float meshSize =  ballSize / 200;       //200 is size of the mesh.
-
-    for (int x = 0; x < cubeSize; x++) {
-      for (int y = 0; y < cubeSize; y++) {
-        for (int z = 0; z < cubeSize; z++) {
-          Ogre::Entity* ballMesh = mSceneMgr->createEntity("sphere.mesh");
-          ballMesh->setMaterialName("Examples/SphereMappedRustySteel");
-          ballMesh->setCastShadows(true);
-
-          // Attach the node.
-          Ogre::SceneNode* headNode = mSceneMgr->getRootSceneNode()->createChildSceneNode();
-          headNode->attachObject(ballMesh);
-          headNode->setScale(Ogre::Vector3(meshSize, meshSize, meshSize));
-          ballMgr->addMainBall(headNode, x * ballSize, y * ballSize, z * ballSize, ballSize/2);
-        }
-      }
+  void ballSetup (int numBalls) {
+    float ballSize = arena.getBallSize(numBalls);   //diameter
+    float meshSize =  ballSize / 200;               //200 is size of the mesh.
+
+    for (int i = 0; i < numBalls; i++) {
+      Ogre::Entity* ballMesh = mSceneMgr->createEntity("sphere.mesh");
+      ballMesh->setMaterialName("Examples/SphereMappedRustySteel");
+      ballMesh->setCastShadows(true);
+
+      // Attach the node.
+      btVector3 pos = arena.getBallPosition(numBalls, i);
+      Ogre::SceneNode* headNode = mSceneMgr->getRootSceneNode()->createChildSceneNode();
+      headNode->attachObject(ballMesh);
+      headNode->setScale(Ogre::Vector3(meshSize, meshSize, meshSize));
+      ballMgr->addMainBall(headNode, pos.x(), pos.y(), pos.z(), ballSize/2);
     }
   }
 
   void levelSetup(int num) {
-    if(num > 50)
-      num = 50;
     if (!connected)
       srand(time(0));
     else
       srand(1);
 
-    Ogre::Plane wallTile = Ogre::Plane(Ogre::Vector3::UNIT_X, -PLANE_DIST +1);
-
-    // Since each mesh starts at the center of the plane, we need to offset it
-    // to the top right corner of the plane and start counting from there.
-    int offset = WALL_SIZE/2 - TILE_WIDTH/2;
-
-    int x, y, z;
-    x = y = z = 0;
-
-    std::vector<int> randomnumbers;
-    for(int i = 0; i < 50; i++)
-      randomnumbers.push_back(i);
+    // Tile placement is shared with the headless simulation (TileLayout.h).
+    std::vector<int> tileNums = arena.pickTileNumbers(num);
+    num = tileNums.size();
 
     for(int i = 0; i < num; i++) {
       std::stringstream ss;
-      std::stringstream ssDebug;
       ss << (i + tileCounter);
 
-      int rn = std::rand() % randomnumbers.size(); // get random tile in list of unused tiles
-      int tileNum = randomnumbers[rn];
-      randomnumbers.erase(randomnumbers.begin() + rn);
-      ssDebug << tileNum;
-      // std::cout << "Random number1: " + ssDebug.str() << std::endl;
-      ssDebug.str(std::string());
-
-      int wallTileNum = tileNum % NUM_TILES_WALL; //possible number of tiles per wall.
-      ssDebug << wallTileNum;
-      // std::cout << "Random number: " + ssDebug.str() << std::endl;
-      int row = wallTileNum / NUM_TILES_ROW; //5 is the number of tiles per row.
-      int col = wallTileNum % NUM_TILES_ROW;
-
-      ssDebug.str(std::string());
-      ssDebug << row;
-      ssDebug << " ";
-      ssDebug << col;
-
-      // std::cout << "Row/col " + ssDebug.str() << std::endl;
-
-      Ogre::SceneNode* node1; //= mSceneMgr->getRootSceneNode()->createChildSceneNode();
-      int xsize = 240;
-      int ysize = 240;
-      int zsize = 240;
-
-      // left
-      if(tileNum < 25) {
-        // set up x y z units of 0, 1 or -1, which will be used when we setPosition
-        // set up our WallTileLeft or whatever to point to the right direction.
-        wallTile = Ogre::Plane(Ogre::Vector3::UNIT_X, 1);
-        x = 0;
-        y = -1 * (row * TILE_WIDTH) + offset;
-        z = -1 * (col * TILE_WIDTH) + offset;
-        xsize = 10;
-        node1 = mSceneMgr->getSceneNode("leftNode")->createChildSceneNode();
-      }
+      TileSlot slot = arena.getTileSlot(tileNums[i]);
+      Ogre::Plane wallTile;
+      Ogre::SceneNode* node1;
 
-      // front
-      else if (tileNum < 50) {
-        x = 1 * (col * TILE_WIDTH) - offset;
-        y = -1 * (row * TILE_WIDTH) + offset;
-        z = 0;
-        zsize = 10;
+      // Point each tile plane away from its wall.
+      switch (slot.wall) {
+      case WALL_LEFT:
+        wallTile = Ogre::Plane(Ogre::Vector3::UNIT_X, 1);
+        node1 = levelMgr->createNode(mSceneMgr->getSceneNode("leftNode"));
+        break;
+      case WALL_FRONT:
         wallTile = Ogre::Plane(Ogre::Vector3::UNIT_Z, 1);
-        node1 = mSceneMgr->getSceneNode("frontNode")->createChildSceneNode();
-      }
-
-      // right
-      else if (tileNum < 75) {
-        x = 0;
-        y = -1 * (row * TILE_WIDTH) + offset;
-        z = 1 * (col * TILE_WIDTH) - offset;
-        xsize = 10;
+        node1 = levelMgr->createNode(mSceneMgr->getSceneNode("frontNode"));
+        break;
+      case WALL_RIGHT:
         wallTile = Ogre::Plane(Ogre::Vector3::NEGATIVE_UNIT_X, 1);
-        node1 = mSceneMgr->getSceneNode("rightNode")->createChildSceneNode();
-      }
-
-      // back
-      else if (tileNum < 100) {
-        x = 1 * (col * TILE_WIDTH) - offset;
-        y = -1 * (row * TILE_WIDTH) + offset;
-        z = 0;
-        zsize = 10;
+        node1 = levelMgr->createNode(mSceneMgr->getSceneNode("rightNode"));
+        break;
+      default:
         wallTile = Ogre::Plane(Ogre::Vector3::NEGATIVE_UNIT_Z, 1);
-        node1 = mSceneMgr->getSceneNode("backNode")->createChildSceneNode();
+        node1 = levelMgr->createNode(mSceneMgr->getSceneNode("backNode"));
+        break;
       }
 
       // Build the entity name based on which tile number it is.
@@ -279,31 +217,21 @@ protected:
       entityStr.append(ss.str());
       // std::cout << "tileEntityName: " + entityStr << std::endl;
 
-      Ogre::MeshManager::getSingleton().createPlane(str,
-          Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, wallTile,
-          TILE_WIDTH, TILE_WIDTH, 20, 20, true, 1, 5, 5, Ogre::Vector3::UNIT_Y);
-      Ogre::Entity* tile = mSceneMgr->createEntity(entityStr, str);
+      // The level manager unloads the mesh again in levelTearDown().
+      levelMgr->createPlaneMesh(str, wallTile, arena.getTileWidth());
+      Ogre::Entity* tile = levelMgr->createEntity(entityStr, str);
 
-      node1->translate(x ,y, z); //1600 / 5 is our tilewidth
+      node1->translate(slot.local.x(), slot.local.y(), slot.local.z());
       node1->attachObject(tile);
       tile->setMaterialName("Examples/Chrome");
       tile->setCastShadows(false);
-      sim->addTile(node1, xsize, ysize, zsize);
+      sim->addTile(tileNums[i]);
       tileEntities.push_back(tile);
-      allTileEntities.push_back(tile);
-      tileList.push_back(node1);
       tileSceneNodes.push_back(node1);
     }
     tileCounter += num;
 
-    int it, numballs;
-    it = numballs = 1;
-    while (numballs < num) {
-      it++;
-      numballs = it * it * it;
-    }
-
-    ballSetup(it);
+    ballSetup(arena.getNumBalls(num));
 
     soundMgr->playSound(gong);
 
@@ -314,24 +242,22 @@ protected:
 
 
   void levelTearDown() {
-    ballMgr->clearBalls();
-
-    for(int i = 0; i < tileList.size(); i++)
-      mSceneMgr->destroySceneNode(tileList[i]);
-    for(int i = 0; i < allTileEntities.size(); i++)
-      mSceneMgr->destroyEntity(allTileEntities[i]);
-    tileList.clear();
-    allTileEntities.clear();
+    // Balls, tile bodies, tile meshes, entities and nodes.
+    levelMgr->tearDown();
+    tileEntities.clear();
+    tileSceneNodes.clear();
 
     currLevel++;
   }
 
   void setLevel(int num) {
+    lockPhysics();
     levelTearDown();
     currLevel = num;
     score = 0;
     shotsFired = 0;
     levelSetup(num);
+    unlockPhysics();
   }
 
   void drawPlayers() {
@@ -390,12 +316,32 @@ protected:
     }
   }
 
+  /* Queues a message on one of netMgr's send rings.  A full ring is sent
+   * first to make room; a message that still does not fit is reported. */
+  bool queueMessage(Protocol protocol, Uint32 tag, const void *body, int len) {
+    MessageRing& ring = (protocol == PROTOCOL_TCP) ?
+        netMgr->tcpServerData.input : netMgr->udpServerData.input;
+
+    if (ring.push(tag, body, len))
+      return true;
+
+    if (server)
+      netMgr->messageClients(protocol);
+    else
+      netMgr->messageServer(protocol);
+
+    if (ring.push(tag, body, len))
+      return true;
+
+    std::cerr << "TileGame: Send ring full, message dropped." << std::endl;
+    return false;
+  }
+
   void updatePlayers(double force = 0, Ogre::Vector3 dir = Ogre::Vector3::ZERO) {
     PlayerData single;
-    int i, pdSize, tagSize;
+    int i, pdSize;
 
     pdSize = sizeof(PlayerData);
-    tagSize = sizeof(Uint32);
 
     // Self
     single.host = netMgr->getIPnbo();
@@ -404,15 +350,11 @@ protected:
     single.shotForce = force;
     single.shotDir = dir;
     single.velocity = mCameraMan->getVelocity();
-    memcpy(netMgr->udpServerData[nPlayers].input, &UINT_UPDPL, tagSize);
-    memcpy((netMgr->udpServerData[nPlayers].input + 4), &single, pdSize);
-    netMgr->udpServerData[nPlayers].updated = true;
+    queueMessage(PROTOCOL_UDP, UINT_UPDPL, &single, pdSize);
 
     // Clients
     for (i = 0; i < playerData.size(); i++) {
-      memcpy(netMgr->udpServerData[i].input, &UINT_UPDPL, tagSize);
-      memcpy((netMgr->udpServerData[i].input + 4), playerData[i], pdSize);
-      netMgr->udpServerData[i].updated = true;
+      queueMessage(PROTOCOL_UDP, UINT_UPDPL, playerData[i], pdSize);
     }
 
     netMgr->messageClients(PROTOCOL_UDP);
@@ -420,10 +362,9 @@ protected:
 
   void updateServer(double force = 0, Ogre::Vector3 dir = Ogre::Vector3::ZERO) {
     PlayerData single;
-    int pdSize, tagSize;
+    int pdSize;
 
     pdSize = sizeof(PlayerData);
-    tagSize = sizeof(Uint32);
 
     // Self
     single.host = netMgr->getIPnbo();
@@ -434,27 +375,27 @@ protected:
     single.velocity = mCameraMan->getVelocity();
 
     if (force) {
-      memcpy(netMgr->tcpServerData.input, &UINT_BLSHT, tagSize);
-      memcpy((netMgr->tcpServerData.input + 4), &single, pdSize);
-      netMgr->tcpServerData.updated = true;
+      queueMessage(PROTOCOL_TCP, UINT_BLSHT, &single, pdSize);
       netMgr->messageServer(PROTOCOL_TCP);
     } else {
-      memcpy(netMgr->udpServerData[0].input, &UINT_UPDSV, tagSize);
-      memcpy((netMgr->udpServerData[0].input + 4), &single, pdSize);
-      netMgr->udpServerData[0].updated = true;
+      queueMessage(PROTOCOL_UDP, UINT_UPDSV, &single, pdSize);
       netMgr->messageServer(PROTOCOL_UDP);
     }
   }
 
   void startMultiplayer() {
-    tileEntities.clear();
-    tileSceneNodes.clear();
-    sim->clearTiles();
     gameDone = true;
 
+    // Peers sharing a level (srand(1) in levelSetup) must step identically.
+    lockPhysics();
+    sim->setDeterministic(true);
+    unlockPhysics();
+
     setLevel(1);
     drawPlayers();
+    lockPhysics();
     ballMgr->initMultiplayer(nPlayers);
+    unlockPhysics();
 
     multiplayerStarted = true;
   }
@@ -491,10 +432,9 @@ protected:
 
   void notifyPlayers() {
     PlayerData single;
-    int i, pdSize, tagSize;
+    int i, pdSize;
 
     pdSize = sizeof(PlayerData);
-    tagSize = sizeof(Uint32);
 
     // Self
     single.host = netMgr->getIPnbo();
@@ -502,15 +442,12 @@ protected:
     single.newDir = mCamera->getOrientation();
     single.shotForce = 0;
     single.shotDir = Ogre::Vector3::ZERO;
-    memcpy(netMgr->udpServerData[nPlayers].input, &UINT_ADDPL, tagSize);
-    memcpy((netMgr->udpServerData[nPlayers].input + 4), &single, pdSize);
-    netMgr->udpServerData[nPlayers].updated = true;
+    single.velocity = Ogre::Vector3::ZERO;
+    queueMessage(PROTOCOL_UDP, UINT_ADDPL, &single, pdSize);
 
     // Clients
     for (i = 0; i < playerData.size(); i++) {
-      memcpy(netMgr->udpServerData[i].input, &UINT_ADDPL, tagSize);
-      memcpy((netMgr->udpServerData[i].input + 4), playerData[i], pdSize);
-      netMgr->udpServerData[i].updated = true;
+      queueMessage(PROTOCOL_UDP, UINT_ADDPL, playerData[i], pdSize);
     }
 
     netMgr->messageClients(PROTOCOL_UDP);
@@ -518,10 +455,9 @@ protected:
 
   void notifyServer() {
     PlayerData single;
-    int pdSize, tagSize;
+    int pdSize;
 
     pdSize = sizeof(PlayerData);
-    tagSize = sizeof(Uint32);
 
     // Self
     single.host = netMgr->getIPnbo();
@@ -529,9 +465,8 @@ protected:
     single.newDir = mCamera->getOrientation();
     single.shotForce = 0;
     single.shotDir = Ogre::Vector3::ZERO;
-    memcpy(netMgr->udpServerData[0].input, &UINT_ADDPL, tagSize);
-    memcpy((netMgr->udpServerData[0].input + 4), &single, pdSize);
-    netMgr->udpServerData[0].updated = true;
+    single.velocity = Ogre::Vector3::ZERO;
+    queueMessage(PROTOCOL_UDP, UINT_ADDPL, &single, pdSize);
     netMgr->messageServer(PROTOCOL_UDP);
   }
 
@@ -0,0 +1,548 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    TileHeadless.cpp
+-----------------------------------------------------------------------------
+
+Render-less physics runner for soak tests and benchmarks.
+
+  TileHeadless [-l level] [-n levels] [-t ticks] [-r fps] [-s seed]
+               [-j threads] [-c ccdratio] [-b dbvt|sap] [-x sequential|nncg]
+               [-i iterations] [-S] [-R replays] [-P csvfile] [-D]
+               [-H tracefile] [-C tracefile] [-e bullet|spheres] [-A balls]
+               [-z sleepsecs]
+               [-a wallsize] [-g tilesperrow] [-w walls] [-m balls]
+               [-B maxthreads | -M | -K cycles | -V]
+
+Plays 'levels' consecutive levels starting at 'level', each for at most
+'ticks' physics ticks with frames 1/fps seconds apart, and prints step
+timings and tile hits.  -j runs a multithreaded world and -c sets the
+speed, in ball radii per tick, above which balls are swept (0 turns
+continuous collision detection off).  -b, -x, -i and -S pick the
+broadphase, constraint solver, solver iterations and split impulse.  -R
+replays each level that many more times from the snapshot taken when it
+was set up.  -P prints mean physics phase timings and writes the last
+frames' timings to 'csvfile'.  -D runs a deterministic world, whose shots,
+hits and level ends fall on the same ticks at any frame rate.  -H writes a
+hash of the world after every tick to 'tracefile', a replay's ticks
+replacing the ones it plays again; -C compares the run against such a
+trace and reports the first tick and the balls that differ.  -e spheres
+steps the balls with the sphere-only engine instead of Bullet, and -A
+drops that many extra balls into every level, e.g. "TileHeadless -e
+spheres -A 3000 -P party.csv" against the same run with -e bullet.  -P also
+reports how many balls were awake and asleep; -z sets how long a ball must
+stay slow before it sleeps (0 keeps every ball awake).
+
+-a, -g, -w and -m change the arena levels are generated in: its edge
+length, the tiles in each row of a wall, which walls get tiles (any of
+"lfrb" for left, front, right and back) and the number of main balls
+(0 for a cube of one per tile).  Level n has n tiles up to the slots on
+the chosen walls, e.g. "TileHeadless -a 12000 -g 50 -w lfrb -m 4000
+-l 5000 -P big.csv" plays a 5000 tile level.
+
+-B instead plays the levels once for every thread count up to 'maxthreads'
+and prints a table of tick times and tile hits per shot, e.g.
+"TileHeadless -l 50 -B 8".  -M does the same for every broadphase, solver,
+iteration count (4, 10, 20), split impulse setting and CCD ratio (0, 0.5).
+-K is a soak test: it sets up, plays and tears down 'cycles' levels,
+printing the world's body count, shape count and resident memory as it
+goes.  After a warm-up pass over the levels it fails if bodies or shapes
+are left behind or resident memory grows by more than 4 MB.  -V plays the
+levels on fresh deterministic worlds at 'fps', 24 and 144 frames a second
+and fails unless every ball ends each level bit-for-bit the same, naming
+the first tick that differs.
+-----------------------------------------------------------------------------
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+
+#include "HeadlessGame.h"
+
+
+static ArenaLayout arena;                 // set from -a, -g, -w and -m.
+static const int VERIFY_RUNS = 3;         // -V's frame rates: -r's, 24 and 144.
+
+static bool initGame(HeadlessGame& game, unsigned int seed, const PhysicsConfig& config) {
+  game.setArena(arena);
+  if (!game.initHeadlessGame(seed, config)) {
+    std::cerr << "TileHeadless: Failed to initialize." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+/* WallMask bits for a string of wall initials, e.g. "lf" or "lfrb". */
+static int parseWalls(const char *s) {
+  int walls = 0;
+
+  for (; *s; s++) {
+    switch (*s) {
+    case 'l': walls |= WALLS_LEFT; break;
+    case 'f': walls |= WALLS_FRONT; break;
+    case 'r': walls |= WALLS_RIGHT; break;
+    case 'b': walls |= WALLS_BACK; break;
+    default:  return 0;
+    }
+  }
+
+  return walls;
+}
+
+static void printStats(const HeadlessStats& stats) {
+  double avgUs = stats.frames ? (double) stats.totalUs / stats.frames : 0;
+
+  std::cout << "levels: " << stats.levels
+      << "  frames: " << stats.frames
+      << "  ticks: " << stats.ticks
+      << "  shots: " << stats.shots
+      << "  hits: " << stats.hits << std::endl;
+  std::cout << "frame avg: " << avgUs << " us"
+      << "  max: " << stats.maxUs << " us"
+      << "  total: " << (stats.totalUs / 1000) << " ms" << std::endl;
+  if (stats.restores)
+    std::cout << "restores: " << stats.restores
+        << "  avg: " << (double) stats.restoreUs / stats.restores << " us" << std::endl;
+}
+
+static void printProfile(PhysicsProfiler& profiler) {
+  ProfileSample avg = profiler.getAverage();
+
+  std::cout << "phase avg over " << profiler.getNumSamples() << " frames:";
+  for (int p = 0; p < PHASE_COUNT; p++)
+    std::cout << "  " << PhysicsProfiler::getPhaseName(p) << " " << avg.ms[p] << " ms";
+  std::cout << std::endl;
+  std::cout << "balls awake: " << avg.awake << "  asleep: " << avg.asleep << std::endl;
+}
+
+static void printDesync(const DesyncReport& report) {
+  if (!report.diverged) {
+    std::cout << "hashes: no divergence" << std::endl;
+    return;
+  }
+
+  std::cout << "hashes: diverged at tick " << report.tick << ", balls";
+  for (size_t i = 0; i < report.bodies.size(); i++)
+    std::cout << " " << report.bodies[i];
+  std::cout << std::endl;
+}
+
+/* True if both snapshots hold the same balls in exactly the same state. */
+static bool sameState(const WorldSnapshot& a, const WorldSnapshot& b, size_t& body) {
+  if (a.bodies.size() != b.bodies.size() || a.tiles.size() != b.tiles.size()) {
+    body = 0;
+    return false;
+  }
+
+  for (body = 0; body < a.bodies.size(); body++) {
+    const BodySnapshot& x = a.bodies[body];
+    const BodySnapshot& y = b.bodies[body];
+    btQuaternion qx = x.transform.getRotation(), qy = y.transform.getRotation();
+
+    for (int i = 0; i < 3; i++) {
+      if (x.transform.getOrigin()[i] != y.transform.getOrigin()[i]
+          || x.linearVelocity[i] != y.linearVelocity[i]
+          || x.angularVelocity[i] != y.angularVelocity[i])
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+      if (qx[i] != qy[i])
+        return false;
+    }
+  }
+
+  return true;
+}
+
+/* -V: plays the levels on fresh deterministic worlds at 'fps' and at a low
+ * and a high frame rate, and compares each run's ticks and the state every
+ * level ends in with the first run's. */
+static int verifyDeterminism(PhysicsConfig config, int level, int levels, int ticks, int fps,
+    unsigned int seed) {
+  const int rates[VERIFY_RUNS] = { fps, 24, 144 };
+  std::vector<WorldSnapshot> runs[VERIFY_RUNS];
+  std::vector<StateHashLog> logs(VERIFY_RUNS, StateHashLog(levels * ticks));
+
+  config.deterministic = true;
+
+  for (int r = 0; r < VERIFY_RUNS; r++) {
+    HeadlessGame game;
+    if (!initGame(game, seed, config))
+      return 1;
+    game.setFrameRate(rates[r]);
+    game.getSimulator()->setHashLog(&logs[r]);
+
+    runs[r].resize(levels);
+    for (int i = 0; i < levels; i++) {
+      game.levelSetup(level + i);
+      game.playLevel(ticks);
+      game.getSimulator()->saveSnapshot(runs[r][i]);
+      game.levelTearDown();
+    }
+    game.getSimulator()->setHashLog(NULL);
+  }
+
+  for (int r = 1; r < VERIFY_RUNS; r++) {
+    DesyncReport report = logs[0].compare(logs[r]);
+    if (report.diverged) {
+      std::cout << rates[0] << " fps against " << rates[r] << " fps:" << std::endl;
+      printDesync(report);
+      return 1;
+    }
+
+    for (int i = 0; i < levels; i++) {
+      size_t body;
+      if (!sameState(runs[0][i], runs[r][i], body)) {
+        std::cout << "level " << (level + i) << ": " << rates[0] << " and " << rates[r]
+            << " fps diverge at ball " << body << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  std::cout << "deterministic: " << levels << " level(s) matched at " << rates[0] << ", "
+      << rates[1] << " and " << rates[2] << " fps" << std::endl;
+
+  return 0;
+}
+
+static const char *broadphaseNames[] = { "dbvt", "sap" };
+static const char *solverNames[] = { "sequential", "nncg" };
+
+/* The index of 'name' in 'names', or -1. */
+static int findName(const char *name, const char **names, int count) {
+  for (int i = 0; i < count; i++) {
+    if (!strcmp(name, names[i]))
+      return i;
+  }
+
+  return -1;
+}
+
+static void printBenchHeader() {
+  std::cout << "threads  broadphase      solver  iters  split  ccd  tick avg (us)  frame max (us)"
+      "  shots  hits  hits/shot" << std::endl;
+}
+
+/* Plays the same levels on a fresh world built with 'config' and prints one
+ * row of step times and tiles hit per scripted shot.  Any main ball can hit
+ * the active tile, so this measures how well a configuration plays the
+ * level rather than how often a shot itself lands.  A negative 'ccdRatio'
+ * keeps the simulator's default. */
+static bool benchConfig(const PhysicsConfig& config, double ccdRatio, int level, int levels, int ticks,
+    unsigned int seed) {
+  HeadlessGame game;
+  if (!initGame(game, seed, config))
+    return false;
+  if (ccdRatio >= 0)
+    game.getSimulator()->setCcdRatio(ccdRatio);
+
+  for (int i = 0; i < levels; i++)
+    game.runLevel(level + i, ticks);
+
+  const HeadlessStats& stats = game.getStats();
+  const PhysicsConfig& used = game.getSimulator()->getPhysicsConfig();
+  double avgUs = stats.ticks ? (double) stats.totalUs / stats.ticks : 0;
+  double hitsPerShot = stats.shots ? (double) stats.hits / stats.shots : 0;
+
+  std::cout << std::setw(7) << used.threads
+      << std::setw(12) << broadphaseNames[used.broadphase]
+      << std::setw(12) << solverNames[used.solver]
+      << std::setw(7) << used.solverIterations
+      << std::setw(7) << (used.splitImpulse ? "on" : "off")
+      << std::setw(5) << std::fixed << std::setprecision(1) << game.getSimulator()->getCcdRatio()
+      << std::setw(15) << avgUs
+      << std::setw(16) << stats.maxUs
+      << std::setw(7) << stats.shots
+      << std::setw(6) << stats.hits
+      << std::setw(11) << std::setprecision(2) << hitsPerShot << std::endl;
+
+  return true;
+}
+
+/* -B: one row per thread count. */
+static int benchThreads(const PhysicsConfig& base, double ccdRatio, int level, int levels, int ticks,
+    int maxThreads, unsigned int seed) {
+  printBenchHeader();
+
+  for (int t = 1; t <= maxThreads; t++) {
+    PhysicsConfig config = base;
+    config.threads = t;
+
+    if (!benchConfig(config, ccdRatio, level, levels, ticks, seed))
+      return 1;
+  }
+
+  return 0;
+}
+
+/* -M: one row per broadphase, solver, solver iteration count, split
+ * impulse setting and CCD ratio. */
+static int benchMatrix(const PhysicsConfig& base, int level, int levels, int ticks, unsigned int seed) {
+  const int iterations[] = { 4, 10, 20 };
+  const double ccdRatios[] = { 0, 0.5 };
+
+  printBenchHeader();
+
+  for (int bp = BROADPHASE_DBVT; bp <= BROADPHASE_SAP; bp++) {
+    for (int sv = SOLVER_SEQUENTIAL; sv <= SOLVER_NNCG; sv++) {
+      for (int it = 0; it < 3; it++) {
+        for (int split = 0; split < 2; split++) {
+          for (int ccd = 0; ccd < 2; ccd++) {
+            PhysicsConfig config = base;
+            config.broadphase = bp;
+            config.solver = sv;
+            config.solverIterations = iterations[it];
+            config.splitImpulse = split;
+
+            if (!benchConfig(config, ccdRatios[ccd], level, levels, ticks, seed))
+              return 1;
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Resident set size in KB, or 0 where /proc is not available. */
+static long residentKb() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+
+  if (!f)
+    return 0;
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+    resident = 0;
+  fclose(f);
+
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static const long SOAK_RSS_SLACK_KB = 4096;   // heap noise a soak run tolerates.
+
+/* -K: cycles through 'levels' levels starting at 'level' until 'cycles'
+ * have been played, reporting ten times along the way.  The first pass over
+ * the levels is a warm-up: pooled balls keep the shapes of the last level
+ * they were used in and the heap settles.  After it, the run fails if the
+ * world keeps more bodies, more shapes than any level of the warm-up left
+ * behind, or grows by more than SOAK_RSS_SLACK_KB. */
+static int soak(const PhysicsConfig& config, int level, int levels, int ticks, int cycles,
+    unsigned int seed) {
+  HeadlessGame game;
+  if (!initGame(game, seed, config))
+    return 1;
+
+  btDiscreteDynamicsWorld& world = game.getSimulator()->getDynamicsWorld();
+  int report = cycles >= 10 ? cycles / 10 : 1;
+  int warmup = levels > 0 ? levels : 1;
+  int baseBodies = 0, baseShapes = 0, maxShapes = 0;
+  long baseKb = 0, maxKb = 0;
+
+  std::cout << "  cycle  bodies  shapes  pooled balls  rss (KB)" << std::endl;
+
+  for (int c = 1; c <= cycles; c++) {
+    game.runLevel(level + (c - 1) % warmup, ticks);
+
+    int bodies = world.getNumCollisionObjects();
+    int shapes = game.getSimulator()->getNumShapes();
+    long kb = residentKb();
+
+    if (c == 1)
+      baseBodies = bodies;
+    if (c <= warmup) {
+      if (shapes > baseShapes)
+        baseShapes = shapes;
+      baseKb = kb;
+    } else {
+      if (shapes > maxShapes)
+        maxShapes = shapes;
+      if (kb > maxKb)
+        maxKb = kb;
+    }
+
+    if (c == 1 || c % report == 0 || c == cycles) {
+      std::cout << std::setw(7) << c
+          << std::setw(8) << bodies
+          << std::setw(8) << shapes
+          << std::setw(14) << game.getBallManager()->getNumPooledBalls()
+          << std::setw(10) << kb << std::endl;
+    }
+  }
+
+  int bodyGrowth = world.getNumCollisionObjects() - baseBodies;
+  int shapeGrowth = maxShapes > baseShapes ? maxShapes - baseShapes : 0;
+  long kbGrowth = maxKb > baseKb ? maxKb - baseKb : 0;
+
+  std::cout << "body growth: " << bodyGrowth
+      << "  shape growth: " << shapeGrowth
+      << "  rss growth: " << kbGrowth << " KB";
+  if (cycles <= warmup)
+    std::cout << "  (no cycles after the " << warmup << " warm-up)";
+  std::cout << std::endl;
+
+  return (bodyGrowth || shapeGrowth || kbGrowth > SOAK_RSS_SLACK_KB) ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+  int level = 1, levels = 1, ticks = 3600, fps = 60, benchMax = 0, replays = 0, cycles = 0;
+  int partyBalls = 0;
+  bool matrix = false, verify = false;
+  unsigned int seed = 1;
+  int i, cleared = 0;
+  double ccdRatio = -1;
+  const char *profileCsv = NULL;
+  const char *traceOut = NULL, *traceIn = NULL;
+  PhysicsConfig config;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-l") && i + 1 < argc)
+      level = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      levels = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      ticks = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      fps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+      config.threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+      ccdRatio = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc && findName(argv[i + 1], broadphaseNames, 2) >= 0)
+      config.broadphase = findName(argv[++i], broadphaseNames, 2);
+    else if (!strcmp(argv[i], "-x") && i + 1 < argc && !strcmp(argv[i + 1], "sequential")) {
+      config.solver = SOLVER_SEQUENTIAL;
+      i++;
+    } else if (!strcmp(argv[i], "-x") && i + 1 < argc && !strcmp(argv[i + 1], "nncg")) {
+      config.solver = SOLVER_NNCG;
+      i++;
+    } else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+      config.solverIterations = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-S"))
+      config.splitImpulse = true;
+    else if (!strcmp(argv[i], "-P") && i + 1 < argc)
+      profileCsv = argv[++i];
+    else if (!strcmp(argv[i], "-R") && i + 1 < argc)
+      replays = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-B") && i + 1 < argc)
+      benchMax = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-M"))
+      matrix = true;
+    else if (!strcmp(argv[i], "-H") && i + 1 < argc)
+      traceOut = argv[++i];
+    else if (!strcmp(argv[i], "-C") && i + 1 < argc)
+      traceIn = argv[++i];
+    else if (!strcmp(argv[i], "-D"))
+      config.deterministic = true;
+    else if (!strcmp(argv[i], "-V"))
+      verify = true;
+    else if (!strcmp(argv[i], "-K") && i + 1 < argc)
+      cycles = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-e") && i + 1 < argc && !strcmp(argv[i + 1], "bullet")) {
+      config.engine = ENGINE_BULLET;
+      i++;
+    } else if (!strcmp(argv[i], "-e") && i + 1 < argc && !strcmp(argv[i + 1], "spheres")) {
+      config.engine = ENGINE_SPHERES;
+      i++;
+    } else if (!strcmp(argv[i], "-A") && i + 1 < argc)
+      partyBalls = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-z") && i + 1 < argc)
+      config.sleepTime = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+      arena.wallSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+      arena.tilesPerRow = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+      arena.walls = parseWalls(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+      arena.numBalls = atoi(argv[++i]);
+    else {
+      std::cerr << "usage: " << argv[0]
+          << " [-l level] [-n levels] [-t ticks] [-r fps] [-s seed]"
+          << " [-j threads] [-c ccdratio] [-b dbvt|sap] [-x sequential|nncg]"
+          << " [-i iterations] [-S]"
+          << " [-R replays] [-P csvfile] [-D] [-H tracefile] [-C tracefile]"
+          << " [-e bullet|spheres] [-A balls] [-z sleepsecs]"
+          << " [-a wallsize] [-g tilesperrow] [-w walls] [-m balls]"
+          << " [-B maxthreads | -M | -K cycles | -V]" << std::endl;
+      return 1;
+    }
+  }
+
+  if (!arena.isValid()) {
+    std::cerr << "TileHeadless: Bad arena: " << arena.wallSize << " units, "
+        << arena.tilesPerRow << " tiles per row, walls " << arena.walls << "." << std::endl;
+    return 1;
+  }
+
+  if (benchMax > 0)
+    return benchThreads(config, ccdRatio, level, levels, ticks, benchMax, seed);
+  if (matrix)
+    return benchMatrix(config, level, levels, ticks, seed);
+  if (cycles > 0)
+    return soak(config, level, levels, ticks, cycles, seed);
+  if (verify)
+    return verifyDeterminism(config, level, levels, ticks, fps, seed);
+
+  HeadlessGame game;
+  if (!initGame(game, seed, config))
+    return 1;
+  game.setFrameRate(fps);
+  game.setPartyBalls(partyBalls);
+  if (ccdRatio >= 0)
+    game.getSimulator()->setCcdRatio(ccdRatio);
+
+  PhysicsProfiler profiler(3600);
+  if (profileCsv)
+    game.getSimulator()->setProfiler(&profiler);
+
+  StateHashLog hashLog(levels * ticks);
+  if (traceOut || traceIn)
+    game.getSimulator()->setHashLog(&hashLog);
+
+  for (i = 0; i < levels; i++) {
+    game.levelSetup(level + i);
+    if (game.playLevel(ticks))
+      cleared++;
+
+    for (int r = 0; r < replays && game.restartLevel(); r++)
+      game.playLevel(ticks);
+
+    game.levelTearDown();
+  }
+
+  std::cout << "cleared: " << cleared << "/" << levels << std::endl;
+  printStats(game.getStats());
+
+  if (profileCsv) {
+    printProfile(profiler);
+    if (!profiler.writeCsv(profileCsv))
+      std::cerr << "TileHeadless: Could not write " << profileCsv << std::endl;
+    game.getSimulator()->setProfiler(NULL);
+  }
+
+  if (traceOut && !hashLog.writeTrace(traceOut))
+    std::cerr << "TileHeadless: Could not write " << traceOut << std::endl;
+
+  if (traceIn) {
+    StateHashLog reference;
+    if (!reference.readTrace(traceIn)) {
+      std::cerr << "TileHeadless: Could not read " << traceIn << std::endl;
+      return 1;
+    }
+
+    DesyncReport report = hashLog.compare(reference);
+    printDesync(report);
+    if (report.diverged)
+      return 1;
+  }
+  game.getSimulator()->setHashLog(NULL);
+
+  return 0;
+}
@@ -0,0 +1,301 @@
+/*
+-----------------------------------------------------------------------------
+Filename:    TileLayout.h
+-----------------------------------------------------------------------------
+
+Arena dimensions and tile placement shared by the rendered game and the
+headless simulation.  Nothing in here may depend on a render window, OIS or
+SDL so that both build targets can use it.
+-----------------------------------------------------------------------------
+ */
+#ifndef __TileLayout_h_
+#define __TileLayout_h_
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+const static int WALL_SIZE = 2400;                                  // default edge length of the arena.
+const static int NUM_TILES_ROW = 5;                                 // default number of tiles in each row of a wall.
+const static int BALL_SIZE = 200;                                   // diameter of a main ball.
+const static int MAX_ARENA_TILES = 1 << 20;                         // slots on all four walls at most.
+const static int MAX_TILES_ROW = 512;                               // the longest row MAX_ARENA_TILES allows.
+
+enum TileWall {
+  WALL_LEFT,
+  WALL_FRONT,
+  WALL_RIGHT,
+  WALL_BACK
+};
+
+/* Bits for ArenaLayout::walls. */
+enum WallMask {
+  WALLS_LEFT = 1 << WALL_LEFT,
+  WALLS_FRONT = 1 << WALL_FRONT,
+  WALLS_RIGHT = 1 << WALL_RIGHT,
+  WALLS_BACK = 1 << WALL_BACK,
+  WALLS_DEFAULT = WALLS_LEFT | WALLS_FRONT,
+  WALLS_ALL = WALLS_LEFT | WALLS_FRONT | WALLS_RIGHT | WALLS_BACK
+};
+
+/* A single tile position.  'local' is the offset from the centre of the
+ * owning wall (what the wall's child SceneNode is translated by), 'position'
+ * is the same point in world space. */
+struct TileSlot {
+  int wall;
+  int row;
+  int col;
+  btVector3 local;
+  btVector3 position;
+};
+
+/* The arena a level is generated in.  Every wall carries a square grid of
+ * tilesPerRow x tilesPerRow slots, numbered wall by wall, but levels only
+ * place tiles on the walls set in 'walls'.  The defaults give the original
+ * 2400 unit arena with 5x5 tiles on the left and front walls and a cube of
+ * main balls with one ball per tile. */
+struct ArenaLayout {
+  int wallSize;
+  int tilesPerRow;
+  int walls;                          // WallMask bits of the walls tiles go on.
+  int numBalls;                       // main balls per level, or 0 for a cube of one per tile.
+
+  ArenaLayout():
+    wallSize(WALL_SIZE),
+    tilesPerRow(NUM_TILES_ROW),
+    walls(WALLS_DEFAULT),
+    numBalls(0)
+  {}
+
+  // The initial offset of each wall from the center.
+  int getPlaneDist() const {
+    return wallSize / 2;
+  }
+
+  int getTileWidth() const {
+    return wallSize / tilesPerRow;
+  }
+
+  int getTilesPerWall() const {
+    return tilesPerRow * tilesPerRow;
+  }
+
+  // Slots on all four side walls; tile numbers run from 0 to this.
+  int getNumSlots() const {
+    return 4 * getTilesPerWall();
+  }
+
+  // The row length is bounded before getNumSlots() multiplies it out.
+  bool isValid() const {
+    return wallSize > 0 && tilesPerRow > 0 && tilesPerRow <= wallSize
+        && tilesPerRow <= MAX_TILES_ROW && getNumSlots() <= MAX_ARENA_TILES
+        && (walls & WALLS_ALL) && numBalls >= 0;
+  }
+
+  btVector3 getWallCenter(int wall) const;
+  TileSlot getTileSlot(int tileNum) const;
+  int getTileAt(int wall, const btVector3& point) const;
+  int getMaxLevelTiles() const;
+  std::vector<int> pickTileNumbers(int num) const;
+  int getNumBalls(int numTiles) const;
+  int getBallSize(int numBalls) const;
+  btVector3 getBallPosition(int numBalls, int i) const;
+};
+
+inline btVector3 ArenaLayout::getWallCenter(int wall) const {
+  int dist = getPlaneDist();
+
+  switch (wall) {
+  case WALL_LEFT:   return btVector3(-dist, 0, 0);
+  case WALL_FRONT:  return btVector3(0, 0, -dist);
+  case WALL_RIGHT:  return btVector3(dist, 0, 0);
+  default:          return btVector3(0, 0, dist);
+  }
+}
+
+inline TileSlot ArenaLayout::getTileSlot(int tileNum) const {
+  TileSlot slot;
+
+  // Since each mesh starts at the center of the plane, we need to offset it
+  // to the top right corner of the plane and start counting from there.
+  int width = getTileWidth();
+  int offset = wallSize/2 - width/2;
+  int wallTileNum = tileNum % getTilesPerWall();
+  int x = 0, y, z = 0;
+
+  slot.wall = tileNum / getTilesPerWall();
+  slot.row = wallTileNum / tilesPerRow;
+  slot.col = wallTileNum % tilesPerRow;
+
+  y = -1 * (slot.row * width) + offset;
+
+  switch (slot.wall) {
+  case WALL_LEFT:
+    z = -1 * (slot.col * width) + offset;
+    break;
+  case WALL_FRONT:
+    x = 1 * (slot.col * width) - offset;
+    break;
+  case WALL_RIGHT:
+    z = 1 * (slot.col * width) - offset;
+    break;
+  default:
+    x = 1 * (slot.col * width) - offset;
+    break;
+  }
+
+  slot.local = btVector3(x, y, z);
+  slot.position = getWallCenter(slot.wall) + slot.local;
+
+  return slot;
+}
+
+/* The side wall whose plane has this inward normal, or -1 for the floor and
+ * ceiling. */
+inline int getWallFacing(const btVector3& normal) {
+  if (normal.x() > 0.5)
+    return WALL_LEFT;
+  if (normal.x() < -0.5)
+    return WALL_RIGHT;
+  if (normal.z() > 0.5)
+    return WALL_FRONT;
+  if (normal.z() < -0.5)
+    return WALL_BACK;
+  return -1;
+}
+
+/* The inverse of getTileSlot(): the number of the tile on 'wall' covering
+ * the world space 'point', or -1 if the wall has no tiles.  Points past the
+ * wall's edge belong to the nearest edge tile. */
+inline int ArenaLayout::getTileAt(int wall, const btVector3& point) const {
+  int width = getTileWidth();
+  int offset = wallSize/2 - width/2;
+  btScalar along;
+
+  switch (wall) {
+  case WALL_LEFT:   along = offset - point.z(); break;
+  case WALL_FRONT:  along = point.x() + offset; break;
+  case WALL_RIGHT:  along = point.z() + offset; break;
+  case WALL_BACK:   along = point.x() + offset; break;
+  default:          return -1;
+  }
+
+  int row = (int) floor((offset - point.y()) / width + 0.5);
+  int col = (int) floor(along / width + 0.5);
+
+  row = row < 0 ? 0 : (row >= tilesPerRow ? tilesPerRow - 1 : row);
+  col = col < 0 ? 0 : (col >= tilesPerRow ? tilesPerRow - 1 : col);
+
+  return wall * getTilesPerWall() + row * tilesPerRow + col;
+}
+
+/* Slots on the walls levels use. */
+inline int ArenaLayout::getMaxLevelTiles() const {
+  int n = 0;
+
+  for (int wall = WALL_LEFT; wall <= WALL_BACK; wall++) {
+    if (walls & (1 << wall))
+      n += getTilesPerWall();
+  }
+
+  return n;
+}
+
+/* Draws 'num' distinct tile numbers from the slots on the level's walls
+ * using std::rand(), so callers control reproducibility through srand().
+ * Each draw takes the rn'th unused slot in order, found through a Fenwick
+ * tree of unused counts so big arenas don't shift a list per pick. */
+inline std::vector<int> ArenaLayout::pickTileNumbers(int num) const {
+  std::vector<int> picked, slots;
+
+  if (num > getMaxLevelTiles())
+    num = getMaxLevelTiles();
+
+  for (int wall = WALL_LEFT; wall <= WALL_BACK; wall++) {
+    if (!(walls & (1 << wall)))
+      continue;
+    for (int i = 0; i < getTilesPerWall(); i++)
+      slots.push_back(wall * getTilesPerWall() + i);
+  }
+
+  int size = slots.size();
+  int top = 1;
+  while (top * 2 <= size)
+    top *= 2;
+
+  std::vector<int> unused(size + 1, 0);
+  for (int i = 1; i <= size; i++) {
+    unused[i] += 1;
+    if (i + (i & -i) <= size)
+      unused[i + (i & -i)] += unused[i];
+  }
+
+  picked.reserve(num);
+  for (int i = 0; i < num; i++) {
+    int rn = std::rand() % (size - i); // get random tile in list of unused tiles
+    int pos = 0;
+
+    for (int step = top; step; step /= 2) {
+      if (pos + step <= size && unused[pos + step] <= rn) {
+        pos += step;
+        rn -= unused[pos];
+      }
+    }
+
+    picked.push_back(slots[pos]);
+    for (int j = pos + 1; j <= size; j += j & -j)
+      unused[j]--;
+  }
+
+  return picked;
+}
+
+/* Edge length of the smallest ball cube holding at least 'num' balls. */
+inline int getCubeSize(int num) {
+  int it, numballs;
+  it = numballs = 1;
+  while (numballs < num) {
+    it++;
+    numballs = it * it * it;
+  }
+
+  return it;
+}
+
+/* Main balls for a level of 'numTiles' tiles. */
+inline int ArenaLayout::getNumBalls(int numTiles) const {
+  if (numBalls > 0)
+    return numBalls;
+
+  int it = getCubeSize(numTiles);
+  return it * it * it;
+}
+
+/* Diameter of each of 'numBalls' main balls.  Cubes that fit in the half of
+ * the arena past the origin keep BALL_SIZE; bigger ones shrink to fit the
+ * middle half of the arena. */
+inline int ArenaLayout::getBallSize(int numBalls) const {
+  int it = getCubeSize(numBalls);
+
+  if (it * BALL_SIZE <= wallSize / 2)
+    return BALL_SIZE;
+
+  int size = wallSize / 2 / it;
+  return size > 2 ? size : 2;
+}
+
+/* Where the i'th of 'numBalls' main balls starts.  Balls fill a cube x, y,
+ * z-major; cubes that keep BALL_SIZE have a corner at the origin as they
+ * always have, smaller balls are centred on it. */
+inline btVector3 ArenaLayout::getBallPosition(int numBalls, int i) const {
+  int it = getCubeSize(numBalls);
+  int size = getBallSize(numBalls);
+  btScalar origin = size == BALL_SIZE ? 0 : -(it - 1) * size / 2.0;
+
+  return btVector3(origin + (i / (it * it)) * size,
+      origin + (i / it % it) * size,
+      origin + (i % it) * size);
+}
+
+#endif // #ifndef __TileLayout_h_
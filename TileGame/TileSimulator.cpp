@@ -1,45 +1,147 @@
 #include "TileSimulator.h"
 
 
-TileSimulator::TileSimulator() {
+TileSimulator::TileSimulator():
+ballMgr(0),
+stepHits(0),
+clearedTick(0)
+{
+  liveTiles.resize(arena.getNumSlots());
 }
 
 TileSimulator::~TileSimulator() {
 
 }
 
+/* Tiles have no bodies: a main ball touching a side wall is mapped to the
+ * tile under the contact point.  Walls only ever need to meet balls, and
+ * only main balls touching walls or each other matter to the game. */
 void TileSimulator::initSimulator() {
+  // A sweep and prune broadphase only needs to cover the arena.
+  if (getPhysicsConfig().worldExtent <= 0) {
+    PhysicsConfig cfg = getPhysicsConfig();
+    cfg.worldExtent = arena.wallSize;
+    setPhysicsConfig(cfg);
+  }
+
   Simulator::initSimulator();
+
+  setCollisionMask(ROLE_WALL, COL_MAIN_BALL | COL_BALL);
+
+  for (int role = 0; role < ROLE_COUNT; role++)
+    setCallbackMask(role, 0);
+  setCallbackMask(ROLE_MAIN_BALL, COL_WALL | COL_MAIN_BALL);
 }
 
-bool TileSimulator::simulateStep(double delay) {
-  Simulator::simulateStep(delay);
-  bool ret = targethit;
+/* Runs the ticks.  Each tick fires the shots due on it and then handles its
+ * own contact events, so a hit locks its ball before the next tick moves it
+ * however many ticks a frame runs.  Returns true if any tile was hit;
+ * getNumHits() says how many. */
+bool TileSimulator::runTicks(int n, btScalar alpha) {
+  if (profiler)
+    profiler->beginFrame();
 
-  if (targethit) {
-    if (tiles.size() > 1) {
-      tiles.pop_back();
-      activetile = tiles.back();
-    } else if (!tiles.empty()) {
+  stepHits = 0;
+  Simulator::runTicks(n, alpha);
+
+  if (profiler)
+    profiler->endFrame();
+
+  return stepHits > 0;
+}
+
+void TileSimulator::tick() {
+  fireShots();
+
+  size_t first = getContactEvents().size();
+  Simulator::tick();
+
+  if (profiler) {
+    btClock timer;
+    handleContacts(first);
+    profiler->addTime(PHASE_CONTACTS, timer.getTimeMicroseconds() / 1000.0);
+  } else
+    handleContacts(first);
+}
+
+/* Fires every queued shot that is due before the coming tick. */
+void TileSimulator::fireShots() {
+  while (ballMgr && !shots.empty() && shots.front().tick <= getTickCount()) {
+    const ShotInput& shot = shots.front();
+
+    ballMgr->fireBall(shot.player, shot.node, shot.position, shot.direction, shot.force);
+    shots.pop_front();
+  }
+}
+
+/* Feeds the tick's contact events, from 'first' on, to the ball manager in
+ * order.  Each hit retires the active tile, so one tick can clear several
+ * tiles; the tick that clears the last one also drops the balls. */
+void TileSimulator::handleContacts(size_t first) {
+  const std::vector<ContactEvent>& events = getContactEvents();
+
+  for (size_t i = first; ballMgr && i < events.size(); i++) {
+    int tile = getTileHit(events[i]);
+
+    if (ballMgr->checkCollisions(tile >= 0 && tile == getActiveTile(), events[i].body0, events[i].body1)) {
+      liveTiles[tile] = false;
       tiles.pop_back();
-    } else
-      activetile = NULL;
+      stepHits++;
 
-    targethit = false;
+      if (tiles.empty()) {
+        clearedTick = getTickCount();
+        ballMgr->enableGravity();
+      }
+    }
   }
+}
+
+void TileSimulator::saveSnapshot(WorldSnapshot& snap) {
+  Simulator::saveSnapshot(snap);
+  snap.tiles.assign(tiles.begin(), tiles.end());
+}
+
+bool TileSimulator::restoreSnapshot(const WorldSnapshot& snap) {
+  if (!Simulator::restoreSnapshot(snap))
+    return false;
+
+  tiles.assign(snap.tiles.begin(), snap.tiles.end());
+  liveTiles.assign(liveTiles.size(), false);
+  for (size_t i = 0; i < snap.tiles.size(); i++)
+    liveTiles[snap.tiles[i]] = true;
+  stepHits = 0;
+  clearedTick = 0;
+  clearShots();
+
+  return true;
+}
+
+/* Tiles are live until hit, in reverse order of adding. */
+void TileSimulator::addTile(int tileNum) {
+  if (tileNum < 0 || tileNum >= arena.getNumSlots() || liveTiles[tileNum])
+    return;
 
-  return ret;
+  tiles.push_back(tileNum);
+  liveTiles[tileNum] = true;
+  clearedTick = 0;
 }
 
-btRigidBody* TileSimulator::addTile(Ogre::SceneNode *n, int x, int y, int z)  {
-  btRigidBody *box = Simulator::addBoxShape(n, x, y, z);
+/* The live tile a contact event lands on: a main ball touching a side wall
+ * within a live tile's square.  -1 for anything else. */
+int TileSimulator::getTileHit(const ContactEvent& event) {
+  const btCollisionObject *wall;
 
-  tiles.push_back(box);
-  activetile = box;
+  if (getBodyRole(event.body0) == ROLE_WALL && getBodyRole(event.body1) == ROLE_MAIN_BALL)
+    wall = event.body0;
+  else if (getBodyRole(event.body1) == ROLE_WALL && getBodyRole(event.body0) == ROLE_MAIN_BALL)
+    wall = event.body1;
+  else
+    return -1;
 
-  registerCallback((void *) tileCallback);
+  const btStaticPlaneShape *plane = static_cast<const btStaticPlaneShape *>(wall->getCollisionShape());
+  int tile = arena.getTileAt(getWallFacing(plane->getPlaneNormal()), event.position);
 
-  return box;
+  return isTileLive(tile) ? tile : -1;
 }
 
 btRigidBody* TileSimulator::addBallShape(Ogre::SceneNode *n, int r)  {
@@ -48,20 +150,76 @@ btRigidBody* TileSimulator::addBallShape(Ogre::SceneNode *n, int r)  {
   return ball;
 }
 
+btRigidBody* TileSimulator::addBallShape(Ogre::SceneNode *n, const btVector3& pos, int r)  {
+  btRigidBody *ball = Simulator::addBallShape(n, pos, r, 1);
+
+  return ball;
+}
+
+btRigidBody* TileSimulator::reuseBallShape(btRigidBody *body, Ogre::SceneNode *n, const btVector3& pos, int r)  {
+  return Simulator::reuseBallShape(body, n, pos, r, 1);
+}
+
+/* The tile to hit next, or -1 once the level's tiles are all hit. */
+int TileSimulator::getActiveTile() {
+  return tiles.empty() ? -1 : tiles.back();
+}
+
+bool TileSimulator::isTileLive(int tileNum) {
+  return tileNum >= 0 && tileNum < (int) liveTiles.size() && liveTiles[tileNum];
+}
+
+int TileSimulator::getNumTiles() {
+  return tiles.size();
+}
+
+int TileSimulator::getNumHits() {
+  return stepHits;
+}
+
+unsigned long TileSimulator::getClearedTick() {
+  return clearedTick;
+}
+
+/* Queues a shot for the tick it is stamped with.  Shots stamped with a tick
+ * already run fire before the next one.  Equal stamps keep their order. */
+void TileSimulator::queueShot(const ShotInput& shot) {
+  std::deque<ShotInput>::iterator it = shots.end();
+
+  while (it != shots.begin() && (it - 1)->tick > shot.tick)
+    it--;
+  shots.insert(it, shot);
+}
+
+/* Drops the queued shots with their nodes. */
+void TileSimulator::clearShots() {
+  std::deque<ShotInput>::iterator it;
+
+  for (it = shots.begin(); it != shots.end(); it++)
+    Ball::destroyNode(it->node);
+  shots.clear();
+}
+
 void TileSimulator::setBallManager(BallManager *bM) {
-  tileBallMgr = bM;
+  ballMgr = bM;
 }
 
-void TileSimulator::clearTiles() {
+/* Sets the arena tile numbers and hits refer to.  Call it before
+ * initSimulator() so the broadphase covers the arena; it clears the tiles. */
+void TileSimulator::setArena(const ArenaLayout& layout) {
+  arena = layout;
   tiles.clear();
-  activetile = NULL;
+  liveTiles.assign(arena.getNumSlots(), false);
 }
 
-bool TileSimulator::tileCallback(btManifoldPoint& cp, void *body0, void *body1) {
-  if (!activetile || targethit)
-    return true;
-
-  targethit = tileBallMgr->checkCollisions(activetile, body0, body1);
+const ArenaLayout& TileSimulator::getArena() {
+  return arena;
+}
 
-  return targethit;
+/* Also drops shots still queued for the level. */
+void TileSimulator::clearTiles() {
+  tiles.clear();
+  liveTiles.assign(liveTiles.size(), false);
+  clearedTick = 0;
+  clearShots();
 }
@@ -10,18 +10,27 @@ Filename:    TileSimulator.h
 
 #include <bullet/btBulletDynamicsCommon.h>
 #include <OgreSceneManager.h>
+#include <deque>
 #include <vector>
 
 #include "Simulator.h"
 #include "BallManager.h"
+#include "TileLayout.h"
 
 
 class BallManager;
 class Ball;
 
-static btRigidBody *activetile;
-static BallManager *tileBallMgr;
-static bool targethit;
+/* A shot to fire once the world has run 'tick' ticks, i.e. just before the
+ * next one.  The node, if any, is already placed at 'position'. */
+struct ShotInput {
+  unsigned long tick;
+  int player;                         // index into playerBalls, or -1 for the global ball.
+  Ogre::SceneNode *node;
+  btVector3 position;
+  btVector3 direction;
+  double force;
+};
 
 class TileSimulator : public Simulator {
 
@@ -30,16 +39,39 @@ public:
   virtual ~TileSimulator();
 
   virtual void initSimulator();
-  virtual bool simulateStep(double delay);
+  virtual void saveSnapshot(WorldSnapshot& snap);
+  virtual bool restoreSnapshot(const WorldSnapshot& snap);
   virtual btRigidBody* addBallShape(Ogre::SceneNode *n, int r);
-  btRigidBody* addTile(Ogre::SceneNode *n, int x, int y, int z);
+  virtual btRigidBody* addBallShape(Ogre::SceneNode *n, const btVector3& pos, int r);
+  virtual btRigidBody* reuseBallShape(btRigidBody *body, Ogre::SceneNode *n, const btVector3& pos, int r);
+  void addTile(int tileNum);
+  int getActiveTile();
+  bool isTileLive(int tileNum);
+  int getNumTiles();
+  int getNumHits();
+  unsigned long getClearedTick();
+  void queueShot(const ShotInput& shot);
+  void clearShots();
   void setBallManager(BallManager *bM);
+  void setArena(const ArenaLayout& layout);
+  const ArenaLayout& getArena();
   void clearTiles();
 
-  static bool tileCallback(btManifoldPoint& cp, void *body0, void *body1);
+protected:
+  virtual bool runTicks(int n, btScalar alpha);
+  virtual void tick();
+  void fireShots();
+  void handleContacts(size_t first);
+  int getTileHit(const ContactEvent& event);
 
 private:
-  std::deque<btRigidBody *> tiles;
+  std::deque<int> tiles;                          // tiles still to hit; the back one is active.
+  std::vector<bool> liveTiles;                    // the same tiles, indexed by tile number.
+  ArenaLayout arena;
+  BallManager *ballMgr;
+  std::deque<ShotInput> shots;                    // queued shots in tick order.
+  int stepHits;                                   // tiles hit during the last simulateStep().
+  unsigned long clearedTick;                      // tick the last tile was hit on, or 0.
 };
 
 #endif // #ifndef __TileSimulator_h_